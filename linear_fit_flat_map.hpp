@@ -0,0 +1,430 @@
+#pragma once
+
+// Sorted vector associative containers that find keys with a line fit to them, like BoundedLineFitIndex in
+// linear_fit_search.hpp: the line says where a key should be, and std::lower_bound only looks as far from there as the
+// keys are known to be from the line. The keys and the values are kept in separate arrays, so a search only touches
+// keys.
+//
+//   lfs::FlatMap<uint64_t, Metadata> map;
+//   map.insert(key, metadata);
+//   auto it = map.find(key);
+//   if (it != map.end())
+//       Use(it->first, it->second);
+//
+// Keys have to be arithmetic, since the search fits lines to them. Inserting and erasing move everything after the
+// key, like any flat map, so these are for data that is read much more than it's written. Appending a key larger than
+// all the others doesn't move anything. Each insert or erase widens how far a key can be from the line by one, and the
+// line is fit again once that's grown well past what the last fit had.
+
+#include "linear_fit_search.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lfs
+{
+
+namespace detail
+{
+    // the line is fit again after this many inserts and erases, or an eighth of the keys if that's more
+    static const size_t c_flatRefitChanges = 16;
+
+    // how many keys a fit checks the line against
+    static const size_t c_flatErrorSamples = 64;
+
+    // A line from key to where it is among the sorted keys of a flat container, fit by least squares. It says where
+    // the key is as a fraction of the way through the keys, so it stays close while inserts and erases spread out over
+    // the keys. Lookups gallop out from where it says, so the line being off costs a few reads, not a wrong answer.
+    // Galloping takes about twice as many reads as a binary search of how far off the line is, so when that's more than
+    // a binary search of all of the keys takes, lookups do that instead. Galloping gets one read of slack for reading
+    // close to where it starts.
+    template <typename Key>
+    class FlatKeyLine
+    {
+    public:
+        void Fit(const std::vector<Key>& keys)
+        {
+            m_slope = 0.0;
+            m_intercept = 0.0;
+            m_useLine = true;
+            m_changes = 0;
+            m_refitChanges = std::max(c_flatRefitChanges, keys.size() / 8);
+            if (keys.size() < 2)
+                return;
+
+            double meanKey = 0.0;
+            for (const Key& key : keys)
+                meanKey += double(key);
+            meanKey /= double(keys.size());
+            double meanIndex = double(keys.size() - 1) / 2.0;
+            double covariance = 0.0;
+            double variance = 0.0;
+            for (size_t index = 0; index < keys.size(); ++index)
+            {
+                double dx = double(keys[index]) - meanKey;
+                covariance += dx * (double(index) - meanIndex);
+                variance += dx * dx;
+            }
+
+            // fit to the index, then scaled to the fraction of the keys
+            double lastIndex = double(keys.size() - 1);
+            m_slope = variance > 0.0 ? covariance / variance / lastIndex : 0.0;
+            m_intercept = 0.5 - m_slope * meanKey;
+
+            // the mean log of how far off the line is, from a sample of the keys
+            size_t stride = std::max<size_t>(keys.size() / c_flatErrorSamples, 1);
+            double logError = 0.0;
+            size_t numSamples = 0;
+            for (size_t index = 0; index < keys.size(); index += stride)
+            {
+                size_t predicted = Predict(keys[index], keys.size());
+                logError += std::log2(double(predicted > index ? predicted - index : index - predicted) + 1.0);
+                numSamples++;
+            }
+            logError /= double(numSamples);
+            m_useLine = 2.0 * logError < std::log2(double(keys.size())) + 1.0;
+        }
+
+        // Where key is, or would go, in keys. Gallops out from where the line says until the key is bracketed, then
+        // binary searches what that brackets.
+        size_t LowerBound(const std::vector<Key>& keys, const Key& key) const
+        {
+            if (keys.empty() || !m_useLine)
+                return size_t(std::lower_bound(keys.begin(), keys.end(), key) - keys.begin());
+
+            size_t index = Predict(key, keys.size());
+            size_t minIndex, maxIndex;
+            if (keys[index] < key)
+            {
+                size_t step = 1;
+                while (index + step < keys.size() && keys[index + step] < key)
+                    step *= 2;
+                minIndex = index + step / 2 + 1;
+                maxIndex = std::min(index + step, keys.size());
+            }
+            else
+            {
+                size_t step = 1;
+                while (step <= index && !(keys[index - step] < key))
+                    step *= 2;
+                minIndex = step <= index ? index - step + 1 : 0;
+                maxIndex = index - step / 2;
+            }
+            return size_t(std::lower_bound(keys.begin() + minIndex, keys.begin() + maxIndex, key) - keys.begin());
+        }
+
+        // after a key was inserted or erased
+        void Changed(const std::vector<Key>& keys)
+        {
+            if (++m_changes >= m_refitChanges)
+                Fit(keys);
+        }
+
+    private:
+        size_t Predict(const Key& key, size_t count) const
+        {
+            // clamped as a double, since a key far past the fit keys is past what a size_t holds. Not a number goes
+            // to 0 too.
+            double index = (m_slope * double(key) + m_intercept) * double(count - 1) + 0.5;
+            if (!(index > 0.0))
+                return 0;
+            if (index >= double(count - 1))
+                return count - 1;
+            return size_t(index);
+        }
+
+        double m_slope = 0.0;       // fraction of the way through the keys = slope * key + intercept
+        double m_intercept = 0.0;
+        bool m_useLine = true;      // false if the keys are too far from the line for it to help
+        size_t m_changes = 0;       // inserts and erases since the line was fit
+        size_t m_refitChanges = c_flatRefitChanges;
+    };
+}
+
+// A set of unique keys in a sorted vector
+template <typename Key>
+class FlatSet
+{
+    static_assert(std::is_arithmetic<Key>::value, "FlatSet keys have to be numbers, for the line fit");
+
+public:
+    using key_type = Key;
+    using value_type = Key;
+    using size_type = size_t;
+    using iterator = typename std::vector<Key>::const_iterator;
+    using const_iterator = iterator;
+
+    size_t size() const { return m_keys.size(); }
+    bool empty() const { return m_keys.empty(); }
+    void reserve(size_t count) { m_keys.reserve(count); }
+
+    void clear()
+    {
+        m_keys.clear();
+        m_line.Fit(m_keys);
+    }
+
+    const_iterator begin() const { return m_keys.begin(); }
+    const_iterator end() const { return m_keys.end(); }
+
+    const_iterator lower_bound(const Key& key) const
+    {
+        return m_keys.begin() + m_line.LowerBound(m_keys, key);
+    }
+
+    const_iterator find(const Key& key) const
+    {
+        const_iterator it = lower_bound(key);
+        return (it != end() && *it == key) ? it : end();
+    }
+
+    size_t count(const Key& key) const
+    {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    bool contains(const Key& key) const
+    {
+        return find(key) != end();
+    }
+
+    // returns where the key is, and whether it was added
+    std::pair<const_iterator, bool> insert(const Key& key)
+    {
+        size_t index = m_keys.size();
+        if (!m_keys.empty() && !(m_keys.back() < key))
+        {
+            index = m_line.LowerBound(m_keys, key);
+            if (m_keys[index] == key)
+                return std::make_pair(m_keys.begin() + index, false);
+        }
+
+        m_keys.insert(m_keys.begin() + index, key);
+        m_line.Changed(m_keys);
+        return std::make_pair(m_keys.begin() + index, true);
+    }
+
+    // returns how many keys were erased, which is 0 or 1
+    size_t erase(const Key& key)
+    {
+        const_iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    const_iterator erase(const_iterator it)
+    {
+        size_t index = size_t(it - m_keys.begin());
+        m_keys.erase(it);
+        m_line.Changed(m_keys);
+        return m_keys.begin() + index;
+    }
+
+    Span<Key> Keys() const
+    {
+        return Span<Key>(m_keys);
+    }
+
+private:
+    std::vector<Key> m_keys;
+    detail::FlatKeyLine<Key> m_line;
+};
+
+// A map of unique keys to values, in two sorted vectors. Iterators give pairs of references, since the keys and the
+// values aren't next to each other.
+template <typename Key, typename Value>
+class FlatMap
+{
+    static_assert(std::is_arithmetic<Key>::value, "FlatMap keys have to be numbers, for the line fit");
+
+    template <typename TValue>
+    class Iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using difference_type = ptrdiff_t;
+        using value_type = std::pair<Key, Value>;
+        using reference = std::pair<const Key&, TValue&>;
+
+        // it->first and it->second need something to point at
+        struct pointer
+        {
+            reference pair;
+            const reference* operator->() const { return &pair; }
+        };
+
+        Iterator() : m_keys(nullptr), m_values(nullptr), m_index(0) {}
+        Iterator(const Key* keys, TValue* values, size_t index) : m_keys(keys), m_values(values), m_index(index) {}
+
+        // an iterator converts to a const_iterator
+        operator Iterator<const Value>() const { return Iterator<const Value>(m_keys, m_values, m_index); }
+
+        reference operator*() const { return reference(m_keys[m_index], m_values[m_index]); }
+        pointer operator->() const { return pointer{ **this }; }
+        reference operator[](difference_type offset) const { return *(*this + offset); }
+
+        Iterator& operator++() { ++m_index; return *this; }
+        Iterator& operator--() { --m_index; return *this; }
+        Iterator operator++(int) { Iterator ret = *this; ++m_index; return ret; }
+        Iterator operator--(int) { Iterator ret = *this; --m_index; return ret; }
+        Iterator& operator+=(difference_type offset) { m_index += offset; return *this; }
+        Iterator& operator-=(difference_type offset) { m_index -= offset; return *this; }
+        Iterator operator+(difference_type offset) const { return Iterator(m_keys, m_values, m_index + offset); }
+        Iterator operator-(difference_type offset) const { return Iterator(m_keys, m_values, m_index - offset); }
+        difference_type operator-(const Iterator& other) const { return difference_type(m_index) - difference_type(other.m_index); }
+
+        bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+        bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+        bool operator<(const Iterator& other) const { return m_index < other.m_index; }
+        bool operator>(const Iterator& other) const { return m_index > other.m_index; }
+        bool operator<=(const Iterator& other) const { return m_index <= other.m_index; }
+        bool operator>=(const Iterator& other) const { return m_index >= other.m_index; }
+
+        size_t Index() const { return m_index; }
+
+    private:
+        const Key* m_keys;
+        TValue* m_values;
+        size_t m_index;
+    };
+
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using size_type = size_t;
+    using iterator = Iterator<Value>;
+    using const_iterator = Iterator<const Value>;
+
+    size_t size() const { return m_keys.size(); }
+    bool empty() const { return m_keys.empty(); }
+
+    void clear()
+    {
+        m_keys.clear();
+        m_values.clear();
+        m_line.Fit(m_keys);
+    }
+
+    void reserve(size_t count)
+    {
+        m_keys.reserve(count);
+        m_values.reserve(count);
+    }
+
+    iterator begin() { return MakeIterator(0); }
+    iterator end() { return MakeIterator(m_keys.size()); }
+    const_iterator begin() const { return MakeIterator(0); }
+    const_iterator end() const { return MakeIterator(m_keys.size()); }
+
+    iterator lower_bound(const Key& key)
+    {
+        return MakeIterator(m_line.LowerBound(m_keys, key));
+    }
+
+    const_iterator lower_bound(const Key& key) const
+    {
+        return MakeIterator(m_line.LowerBound(m_keys, key));
+    }
+
+    iterator find(const Key& key)
+    {
+        size_t index = m_line.LowerBound(m_keys, key);
+        return MakeIterator((index < m_keys.size() && m_keys[index] == key) ? index : m_keys.size());
+    }
+
+    const_iterator find(const Key& key) const
+    {
+        size_t index = m_line.LowerBound(m_keys, key);
+        return MakeIterator((index < m_keys.size() && m_keys[index] == key) ? index : m_keys.size());
+    }
+
+    size_t count(const Key& key) const
+    {
+        return find(key) != end() ? 1 : 0;
+    }
+
+    bool contains(const Key& key) const
+    {
+        return find(key) != end();
+    }
+
+    // returns where the key is, and whether it was added. An existing value is left alone.
+    std::pair<iterator, bool> insert(const Key& key, const Value& value)
+    {
+        size_t index = m_keys.size();
+        if (!m_keys.empty() && !(m_keys.back() < key))
+        {
+            index = m_line.LowerBound(m_keys, key);
+            if (m_keys[index] == key)
+                return std::make_pair(MakeIterator(index), false);
+        }
+
+        m_keys.insert(m_keys.begin() + index, key);
+        m_values.insert(m_values.begin() + index, value);
+        m_line.Changed(m_keys);
+        return std::make_pair(MakeIterator(index), true);
+    }
+
+    std::pair<iterator, bool> insert(const std::pair<Key, Value>& keyValue)
+    {
+        return insert(keyValue.first, keyValue.second);
+    }
+
+    // returns the value of the key, adding a default value if it isn't there
+    Value& operator[](const Key& key)
+    {
+        return m_values[insert(key, Value()).first.Index()];
+    }
+
+    // returns how many keys were erased, which is 0 or 1
+    size_t erase(const Key& key)
+    {
+        iterator it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        size_t index = it.Index();
+        m_keys.erase(m_keys.begin() + index);
+        m_values.erase(m_values.begin() + index);
+        m_line.Changed(m_keys);
+        return MakeIterator(index);
+    }
+
+    Span<Key> Keys() const
+    {
+        return Span<Key>(m_keys);
+    }
+
+    const std::vector<Value>& Values() const
+    {
+        return m_values;
+    }
+
+private:
+    iterator MakeIterator(size_t index)
+    {
+        return iterator(m_keys.data(), m_values.data(), index);
+    }
+
+    const_iterator MakeIterator(size_t index) const
+    {
+        return const_iterator(m_keys.data(), m_values.data(), index);
+    }
+
+    std::vector<Key> m_keys;
+    std::vector<Value> m_values;
+    detail::FlatKeyLine<Key> m_line;
+};
+
+}
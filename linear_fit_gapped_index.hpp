@@ -0,0 +1,394 @@
+#pragma once
+
+// An index that keys can be inserted into, built from line fits over arrays with gaps in them, after ALEX (Ding et al,
+// "ALEX: An Updatable Adaptive Learned Index").
+//
+// The keys are split between nodes by key range. Each node keeps its keys in an array with more slots than keys, and a
+// line that maps a key to the slot it should be in. An insert puts the key in the slot the line predicts, if there is
+// a gap there, so most inserts move nothing. A lookup starts at the predicted slot and gallops out from there. When a
+// node gets too full it grows, and when it has too many keys it splits in two. A node whose line fits its keys badly
+// piles them up without gaps between them, so when an insert has to move many keys, the node splits in two as well.
+// Each grow or split fits new lines.
+//
+//   lfs::GappedIndex<uint64_t, uint32_t> index;
+//   index.Insert(key, value);
+//   const uint32_t* value = index.Find(key);
+//
+// Gap slots hold a copy of the next key to their right, and gaps at the end of a node hold the largest key there can
+// be, so the keys of a node never decrease and can be searched without looking at which slots are used.
+
+#include "linear_fit_search.hpp"
+
+#include <limits>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lfs
+{
+
+template <typename Key, typename Value>
+class GappedIndex
+{
+    static_assert(std::is_arithmetic<Key>::value, "GappedIndex keys have to be numbers, for the line fit");
+
+public:
+    struct Params
+    {
+        size_t maxNodeKeys = 4096;      // a node with more keys than this splits in two
+        float initialDensity = 0.5f;    // how full a node is after it's fit
+        float maxDensity = 0.8f;        // a node that would get fuller than this grows. Each grow fits the node again,
+                                        // so the further apart these are, the fewer the grows
+        size_t maxShift = 32;           // a node whose line fits its keys so badly that an insert moves more keys than
+                                        // this splits, once it has at least minSplitKeys keys
+        size_t minSplitKeys = 64;
+    };
+
+    explicit GappedIndex(const Params& params = Params()) : m_params(params) {}
+
+    // Bulk loads sorted, unique keys
+    GappedIndex(Span<Key> keys, Span<Value> values, const Params& params = Params()) : m_params(params)
+    {
+        size_t nodeKeys = std::max<size_t>(m_params.maxNodeKeys / 2, 1);
+        for (size_t first = 0; first < keys.size(); first += nodeKeys)
+        {
+            size_t count = std::min(nodeKeys, keys.size() - first);
+            m_pivots.push_back(keys[first]);
+            m_nodes.emplace_back();
+            m_nodes.back().Fit(keys.data() + first, values.data() + first, count, m_params.initialDensity);
+        }
+        m_size = keys.size();
+    }
+
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+    size_t NumNodes() const
+    {
+        return m_nodes.size();
+    }
+
+    // memory used by the nodes and the pivots
+    size_t Bytes() const
+    {
+        size_t ret = m_pivots.capacity() * sizeof(Key);
+        for (const Node& node : m_nodes)
+            ret += node.Bytes();
+        return ret;
+    }
+
+    // returns the value of the key, or nullptr if it isn't there
+    const Value* Find(const Key& key) const
+    {
+        if (m_nodes.empty())
+            return nullptr;
+        return m_nodes[NodeIndex(key)].Find(key);
+    }
+
+    // returns false if the key was already there, in which case its value is left alone
+    bool Insert(const Key& key, const Value& value)
+    {
+        if (m_nodes.empty())
+        {
+            m_pivots.push_back(key);
+            m_nodes.emplace_back();
+            m_nodes.back().Fit(&key, &value, 1, m_params.initialDensity);
+            m_size++;
+            return true;
+        }
+
+        size_t nodeIndex = NodeIndex(key);
+        Node& node = m_nodes[nodeIndex];
+        size_t next = node.NextUsed(node.LowerBound(key));
+        if (next < node.keys.size() && node.keys[next] == key)
+            return false;
+
+        // a node with too many keys splits, and a node that's too full grows
+        if (node.count + 1 > m_params.maxNodeKeys)
+        {
+            Split(nodeIndex);
+            return Insert(key, value);
+        }
+        if (float(node.count + 1) > m_params.maxDensity * float(node.keys.size()))
+        {
+            node.Refit(m_params.initialDensity);
+            next = node.NextUsed(node.LowerBound(key));
+        }
+
+        size_t moved = node.Insert(key, value, next);
+        if (key < m_pivots[nodeIndex])
+            m_pivots[nodeIndex] = key;
+        m_size++;
+
+        if (moved > m_params.maxShift && node.count >= m_params.minSplitKeys)
+            Split(nodeIndex);
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        std::vector<Key> keys;          // every slot, gaps included
+        std::vector<Value> values;
+        std::vector<uint8_t> used;      // 1 for the slots that hold a key
+        size_t count = 0;
+        double slope = 0.0;             // slot = slope * key + intercept
+        double intercept = 0.0;
+
+        size_t Bytes() const
+        {
+            return keys.capacity() * sizeof(Key) + values.capacity() * sizeof(Value) + used.capacity();
+        }
+
+        size_t Predict(const Key& key) const
+        {
+            // clamped as a double, since a key far past the node's keys is past what a size_t holds
+            double slot = slope * double(key) + intercept;
+            if (!(slot > 0.0))
+                return 0;
+            if (slot >= double(keys.size() - 1))
+                return keys.size() - 1;
+            return size_t(slot);
+        }
+
+        // the first slot whose key isn't less than key, or keys.size(). Gallops out from the predicted slot.
+        size_t LowerBound(const Key& key) const
+        {
+            size_t slot = Predict(key);
+            size_t minIndex, maxIndex;
+            if (keys[slot] < key)
+            {
+                size_t step = 1;
+                while (slot + step < keys.size() && keys[slot + step] < key)
+                    step *= 2;
+                minIndex = slot + step / 2 + 1;
+                maxIndex = std::min(slot + step, keys.size());
+            }
+            else
+            {
+                size_t step = 1;
+                while (step <= slot && !(keys[slot - step] < key))
+                    step *= 2;
+                minIndex = step <= slot ? slot - step + 1 : 0;
+                maxIndex = slot - step / 2;
+            }
+            return size_t(std::lower_bound(keys.begin() + minIndex, keys.begin() + maxIndex, key) - keys.begin());
+        }
+
+        // the first used slot at or after slot, or keys.size()
+        size_t NextUsed(size_t slot) const
+        {
+            while (slot < keys.size() && !used[slot])
+                ++slot;
+            return slot;
+        }
+
+        const Value* Find(const Key& key) const
+        {
+            // gaps copy the key to their right, so the key itself is the used slot at the end of the run
+            size_t slot = NextUsed(LowerBound(key));
+            return (slot < keys.size() && keys[slot] == key) ? &values[slot] : nullptr;
+        }
+
+        // Lays the keys out over count / density slots, each in the slot a line fit by least squares predicts, or the
+        // first free slot after it
+        void Fit(const Key* sortedKeys, const Value* sortedValues, size_t numKeys, float density)
+        {
+            size_t numSlots = std::max<size_t>(size_t(float(numKeys) / density), numKeys + 1);
+
+            double meanKey = 0.0;
+            for (size_t index = 0; index < numKeys; ++index)
+                meanKey += double(sortedKeys[index]);
+            meanKey /= double(numKeys);
+            double meanSlot = double(numKeys - 1) / 2.0;
+            double covariance = 0.0;
+            double variance = 0.0;
+            for (size_t index = 0; index < numKeys; ++index)
+            {
+                double dx = double(sortedKeys[index]) - meanKey;
+                covariance += dx * (double(index) - meanSlot);
+                variance += dx * dx;
+            }
+
+            // the line is fit to where the keys are in the list, then stretched over the slots
+            double stretch = double(numSlots) / double(numKeys);
+            slope = variance > 0.0 ? stretch * covariance / variance : 0.0;
+            intercept = stretch * meanSlot - slope * meanKey;
+
+            keys.assign(numSlots, std::numeric_limits<Key>::max());
+            values.assign(numSlots, Value());
+            used.assign(numSlots, 0);
+            count = numKeys;
+
+            size_t nextFree = 0;
+            for (size_t index = 0; index < numKeys; ++index)
+            {
+                // leave a slot for every key still to come
+                size_t slot = std::max(Predict(sortedKeys[index]), nextFree);
+                slot = std::min(slot, numSlots - (numKeys - index));
+                keys[slot] = sortedKeys[index];
+                values[slot] = sortedValues[index];
+                used[slot] = 1;
+                nextFree = slot + 1;
+            }
+            FillGaps(0, numSlots);
+        }
+
+        // Fits again with the same keys, which gives the node more gaps
+        void Refit(float density)
+        {
+            std::vector<Key> sortedKeys;
+            std::vector<Value> sortedValues;
+            Gather(0, keys.size(), sortedKeys, sortedValues);
+            Fit(sortedKeys.data(), sortedValues.data(), sortedKeys.size(), density);
+        }
+
+        void Gather(size_t begin, size_t end, std::vector<Key>& sortedKeys, std::vector<Value>& sortedValues) const
+        {
+            sortedKeys.reserve(sortedKeys.size() + count);
+            sortedValues.reserve(sortedValues.size() + count);
+            for (size_t slot = begin; slot < end; ++slot)
+            {
+                if (used[slot])
+                {
+                    sortedKeys.push_back(keys[slot]);
+                    sortedValues.push_back(values[slot]);
+                }
+            }
+        }
+
+        // gaps in [begin, end) get the key of the next used slot
+        void FillGaps(size_t begin, size_t end)
+        {
+            Key next = std::numeric_limits<Key>::max();
+            for (size_t slot = end; slot < keys.size(); ++slot)
+            {
+                if (used[slot])
+                {
+                    next = keys[slot];
+                    break;
+                }
+            }
+            for (size_t slot = end; slot > begin; --slot)
+            {
+                if (used[slot - 1])
+                    next = keys[slot - 1];
+                else
+                    keys[slot - 1] = next;
+            }
+        }
+
+        // The key isn't in the node, next is the first used slot with a larger key, and the node has a gap somewhere.
+        // Returns how many keys had to move.
+        size_t Insert(const Key& key, const Value& value, size_t next)
+        {
+            // The key goes after the last used slot with a smaller key, and before the next used slot. Anywhere in
+            // between is a gap, and the predicted slot is the best of them.
+            size_t gapBegin = next;
+            while (gapBegin > 0 && !used[gapBegin - 1])
+                --gapBegin;
+
+            size_t slot;
+            size_t moved = 0;
+            if (gapBegin < next)
+            {
+                slot = Clamp(gapBegin, next - 1, Predict(key));
+            }
+            else
+            {
+                // no gap between them, so shift keys over towards the closest gap to make one
+                size_t right = next;
+                while (right < keys.size() && used[right])
+                    ++right;
+                size_t left = gapBegin;
+                while (left > 0 && used[left - 1])
+                    --left;
+
+                if (right < keys.size() && (left == 0 || right - next <= gapBegin - left))
+                {
+                    MoveSlots(next, right, next + 1);
+                    slot = next;
+                    moved = right - next;
+                }
+                else
+                {
+                    MoveSlots(left, gapBegin, left - 1);
+                    slot = gapBegin - 1;
+                    moved = gapBegin - left;
+                }
+            }
+
+            keys[slot] = key;
+            values[slot] = value;
+            used[slot] = 1;
+            count++;
+
+            // the gaps before the new key now copy it
+            for (size_t gap = slot; gap > 0 && !used[gap - 1]; --gap)
+                keys[gap - 1] = key;
+            return moved;
+        }
+
+        // moves the used slots [begin, end) to start at to, which is one slot over
+        void MoveSlots(size_t begin, size_t end, size_t to)
+        {
+            if (to > begin)
+            {
+                for (size_t slot = end; slot > begin; --slot)
+                    MoveSlot(slot - 1, slot - 1 + (to - begin));
+            }
+            else
+            {
+                for (size_t slot = begin; slot < end; ++slot)
+                    MoveSlot(slot, slot - (begin - to));
+            }
+        }
+
+        void MoveSlot(size_t from, size_t to)
+        {
+            keys[to] = keys[from];
+            values[to] = values[from];
+            used[to] = 1;
+            used[from] = 0;
+        }
+
+        static size_t Clamp(size_t min, size_t max, size_t value)
+        {
+            return value < min ? min : (value > max ? max : value);
+        }
+    };
+
+    // the node whose key range has the key in it. Keys less than every pivot go to the first node.
+    size_t NodeIndex(const Key& key) const
+    {
+        SearchResult result = HybridSearch(Span<Key>(m_pivots), key);
+        if (!result.found && result.index > 0 && key < m_pivots[result.index])
+            return result.index - 1;
+        return result.index;
+    }
+
+    void Split(size_t nodeIndex)
+    {
+        std::vector<Key> sortedKeys;
+        std::vector<Value> sortedValues;
+        m_nodes[nodeIndex].Gather(0, m_nodes[nodeIndex].keys.size(), sortedKeys, sortedValues);
+
+        size_t half = sortedKeys.size() / 2;
+        Node right;
+        right.Fit(sortedKeys.data() + half, sortedValues.data() + half, sortedKeys.size() - half, m_params.initialDensity);
+        m_nodes[nodeIndex].Fit(sortedKeys.data(), sortedValues.data(), half, m_params.initialDensity);
+
+        m_nodes.insert(m_nodes.begin() + nodeIndex + 1, std::move(right));
+        m_pivots.insert(m_pivots.begin() + nodeIndex + 1, sortedKeys[half]);
+    }
+
+    Params m_params;
+    std::vector<Key> m_pivots;  // the smallest key of each node
+    std::vector<Node> m_nodes;
+    size_t m_size = 0;
+};
+
+}
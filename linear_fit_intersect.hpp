@@ -0,0 +1,350 @@
+#pragma once
+
+// Intersections of sorted sets, like the posting lists of a search index. An intersection is a series of searches with
+// a lower bound that only moves forward: each value of one list is looked for in the other, starting from where the
+// last search ended.
+//
+//   std::vector<uint32_t> out(std::min(a.size(), b.size()));
+//   out.resize(lfs::Intersect(lfs::Span(a), lfs::Span(b), out.data()));
+//
+// The lists have to be sorted and without repeats. The output needs room for the smallest list, and can be the first
+// list, to intersect it in place.
+//
+// When one list is much longer than the other, each value of the shorter list is looked for in the longer one by
+// galloping from the lower bound: checking 1, 2, 4... values ahead until the value is passed, then binary searching
+// what that brackets. When the searches move far and the longer list is close to a line, the line guesses where the
+// value is first, and the gallop starts there instead. When the lists are close in size, most searches would only move
+// a value or two, so the lists are merged. Short lists are merged with branches, which get learned when the same lists
+// are intersected again, and longer ones without, four values at a time with SSE2 when the values are 32 bit integers
+// and the lists are about the same size.
+//
+// More than two lists are intersected two at a time, smallest first, so that what's carried from one to the next is
+// short and gets searched for rather than merged.
+
+#include "linear_fit_search.hpp"
+
+#include <algorithm>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LFS_HAS_SSE2() 1
+#include <emmintrin.h>
+#else
+#define LFS_HAS_SSE2() 0
+#endif
+
+namespace lfs
+{
+
+namespace detail
+{
+    // Lists closer in size than this are merged instead of searched, and closer than the block ratio, merged a block at
+    // a time. Galloping wins from about 12 to 1, and blocks only beat the scalar merge on lists about the same size.
+    static const size_t c_intersectMergeRatio = 12;
+    static const size_t c_intersectBlockRatio = 2;
+
+    // Merges of fewer values than this between the two lists branch on them. The branches of a merge that's run more
+    // than once get learned up to a few thousand values, and then branching is faster than not.
+    static const size_t c_intersectBranchlessValues = 6000;
+
+    // searches of a list this many times bigger than the other guess where the key is with a line before galloping
+    static const size_t c_intersectLineFitStride = 1024;
+
+    // The line is only used when the slope of each of this many pieces of the list is within the slack of its average
+    // slope. From the lower bound, the guess is off by about how far the slope differs times how far the search moves,
+    // which on a curve is further than galloping from the lower bound would have gone.
+    static const size_t c_intersectLineFitPieces = 16;
+    static const double c_intersectLineFitSlack = 0.25;
+
+    // The first index at or after from whose value isn't less than key, or the size of the values if there isn't one.
+    // scale is the slope of a line fit to all of the values, in indices per unit of value, and 0 gallops from the lower
+    // bound without guessing.
+    template <typename T>
+    size_t LowerBoundFrom(Span<T> values, size_t from, T key, double scale)
+    {
+        size_t count = values.size();
+        if (from >= count || !(values[from] < key))
+            return from;
+        if (values[count - 1] < key)
+            return count;
+
+        // the line goes through the lower bound, so it's only as far off as the values near it are from the fit
+        size_t guess = from + size_t((double(key) - double(values[from])) * scale);
+        guess = std::min(std::max(guess, from + 1), count - 1);
+
+        // Gallop out from the guess until the key is bracketed. values[from] is less than key and the last value
+        // isn't, so both directions stop in the list.
+        size_t minIndex, maxIndex;
+        size_t step = 1;
+        if (values[guess] < key)
+        {
+            minIndex = guess + 1;
+            while (values[std::min(minIndex + step - 1, count - 1)] < key)
+            {
+                minIndex += step;
+                step *= 2;
+            }
+            maxIndex = std::min(minIndex + step - 1, count - 1);
+        }
+        else
+        {
+            maxIndex = guess;
+            while (maxIndex - from > step && !(values[maxIndex - step] < key))
+            {
+                maxIndex -= step;
+                step *= 2;
+            }
+            minIndex = maxIndex - from > step ? maxIndex - step + 1 : from + 1;
+        }
+        return size_t(std::lower_bound(values.data() + minIndex, values.data() + maxIndex, key) - values.data());
+    }
+
+    // The same without a guess: gallops from the lower bound itself, which is all a search that only moves a little
+    // needs
+    template <typename T>
+    size_t LowerBoundFrom(Span<T> values, size_t from, T key)
+    {
+        size_t maxIndex = from;
+        size_t step = 1;
+        while (maxIndex < values.size() && values[maxIndex] < key)
+        {
+            from = maxIndex + 1;
+            maxIndex += step;
+            step *= 2;
+        }
+        return size_t(std::lower_bound(values.data() + from, values.data() + std::min(maxIndex, values.size()), key) - values.data());
+    }
+
+    // Looks for each value of the smaller list in the larger one, from where the last one was found. Guess is a template
+    // parameter so that the searches without a line don't test for one every time.
+    template <bool Guess, typename T>
+    size_t IntersectGallop(Span<T> smaller, Span<T> larger, double scale, T* out)
+    {
+        size_t count = 0;
+        size_t lowerBound = 0;
+        for (size_t index = 0; index < smaller.size(); ++index)
+        {
+            // a copy, since out can be the list it's read from
+            T value = smaller[index];
+            lowerBound = Guess ? LowerBoundFrom(larger, lowerBound, value, scale) : LowerBoundFrom(larger, lowerBound, value);
+            if (lowerBound == larger.size())
+                break;
+
+            // a match is written at or behind where both lists are read, so out can be either of them
+            if (larger[lowerBound] == value)
+                out[count++] = value;
+        }
+        return count;
+    }
+
+    // Whether a line with the slope scale is close to every piece of the values. There have to be more values than pieces.
+    template <typename T>
+    bool LineFitsPieces(Span<T> values, double scale)
+    {
+        size_t pieceSize = (values.size() - 1) / c_intersectLineFitPieces;
+        for (size_t piece = 0; piece < c_intersectLineFitPieces; ++piece)
+        {
+            size_t first = piece * pieceSize;
+            double pieceScale = double(pieceSize) / (double(values[first + pieceSize]) - double(values[first]));
+            if (pieceScale < scale * (1.0 - c_intersectLineFitSlack) || pieceScale > scale * (1.0 + c_intersectLineFitSlack))
+                return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    size_t IntersectGallop(Span<T> a, Span<T> b, T* out)
+    {
+        bool aIsSmaller = a.size() <= b.size();
+        Span<T> smaller = aIsSmaller ? a : b;
+        Span<T> larger = aIsSmaller ? b : a;
+
+        // Near the lower bound, galloping from it finds a key in fewer reads than galloping from a guess would, since
+        // the guess is off by about the square root of how far it moves. The line only pays when searches move far.
+        double scale = 0.0;
+        if (larger.size() >= smaller.size() * c_intersectLineFitStride && larger[larger.size() - 1] > larger[0])
+        {
+            scale = double(larger.size() - 1) / (double(larger[larger.size() - 1]) - double(larger[0]));
+            if (!LineFitsPieces(larger, scale))
+                scale = 0.0;
+        }
+
+        if (scale > 0.0)
+            return IntersectGallop<true>(smaller, larger, scale, out);
+        return IntersectGallop<false>(smaller, larger, scale, out);
+    }
+
+    // A merge that branches on the values, like std::set_intersection, but that can write over a
+    template <typename T>
+    size_t IntersectMergeBranching(Span<T> a, Span<T> b, T* out)
+    {
+        const T* readA = a.begin();
+        const T* readB = b.begin();
+        T* write = out;
+        while (readA != a.end() && readB != b.end())
+        {
+            if (*readA < *readB)
+                ++readA;
+            else
+            {
+                if (!(*readB < *readA))
+                    *write++ = *readA++;
+                ++readB;
+            }
+        }
+        return size_t(write - out);
+    }
+
+    // A merge with no branches on the values, which a merge of similar lists mispredicts about half the time
+    template <typename T>
+    size_t IntersectMerge(Span<T> a, Span<T> b, T* out, size_t count = 0, size_t indexA = 0, size_t indexB = 0)
+    {
+        while (indexA < a.size() && indexB < b.size())
+        {
+            T valueA = a[indexA];
+            T valueB = b[indexB];
+            out[count] = valueA;
+            count += (valueA == valueB) ? 1 : 0;
+            indexA += (valueA <= valueB) ? 1 : 0;
+            indexB += (valueB <= valueA) ? 1 : 0;
+        }
+        return count;
+    }
+
+#if LFS_HAS_SSE2()
+    // Compares blocks of four values of each list against each other, all sixteen pairs at once, and then moves past
+    // whichever block ends first. The values of a block of a that matched are only written once the block is passed,
+    // so that out can be a. The scalar merge finishes what doesn't fill a block.
+    template <typename T>
+    size_t IntersectMergeSSE2(Span<T> a, Span<T> b, T* out)
+    {
+        static_assert(sizeof(T) == 4, "the SSE2 merge compares 32 bit values");
+
+        size_t capacity = std::min(a.size(), b.size());
+        size_t count = 0;
+        size_t indexA = 0;
+        size_t indexB = 0;
+        int matched = 0;
+        while (indexA + 4 <= a.size() && indexB + 4 <= b.size())
+        {
+            __m128i blockA = _mm_loadu_si128((const __m128i*)(a.data() + indexA));
+            __m128i blockB = _mm_loadu_si128((const __m128i*)(b.data() + indexB));
+
+            // each rotation of b lines a different value of it up with every value of a
+            __m128i equal = _mm_cmpeq_epi32(blockA, blockB);
+            equal = _mm_or_si128(equal, _mm_cmpeq_epi32(blockA, _mm_shuffle_epi32(blockB, _MM_SHUFFLE(0, 3, 2, 1))));
+            equal = _mm_or_si128(equal, _mm_cmpeq_epi32(blockA, _mm_shuffle_epi32(blockB, _MM_SHUFFLE(1, 0, 3, 2))));
+            equal = _mm_or_si128(equal, _mm_cmpeq_epi32(blockA, _mm_shuffle_epi32(blockB, _MM_SHUFFLE(2, 1, 0, 3))));
+            matched |= _mm_movemask_ps(_mm_castsi128_ps(equal));
+
+            T lastA = a[indexA + 3];
+            T lastB = b[indexB + 3];
+            if (lastA <= lastB)
+            {
+                // Every lane is written and only matches are kept, which doesn't branch on them. out may only have room
+                // for the matches, so near its end only they are written.
+                if (count + 4 <= capacity)
+                {
+                    for (size_t lane = 0; lane < 4; ++lane)
+                    {
+                        out[count] = a[indexA + lane];
+                        count += (matched >> lane) & 1;
+                    }
+                }
+                else
+                {
+                    for (size_t lane = 0; lane < 4; ++lane)
+                    {
+                        if ((matched >> lane) & 1)
+                            out[count++] = a[indexA + lane];
+                    }
+                }
+                indexA += 4;
+                matched = 0;
+            }
+            indexB += (lastB <= lastA) ? 4 : 0;
+        }
+
+        // the values of a block that's still being compared that are before the rest of b have seen every value they
+        // could match
+        for (size_t lane = 0; matched && lane < 4 && (indexB == b.size() || a[indexA] < b[indexB]); ++lane, ++indexA)
+        {
+            if ((matched >> lane) & 1)
+                out[count++] = a[indexA];
+        }
+        return IntersectMerge(a, b, out, count, indexA, indexB);
+    }
+#endif
+
+    // The block merge reads whole blocks of the larger list that it has no use for, so it stops paying off sooner
+    template <typename T>
+    size_t IntersectSimilar(Span<T> a, Span<T> b, T* out)
+    {
+        if (a.size() + b.size() < c_intersectBranchlessValues)
+            return IntersectMergeBranching(a, b, out);
+#if LFS_HAS_SSE2()
+        if constexpr (std::is_integral<T>::value && sizeof(T) == 4)
+        {
+            if (std::max(a.size(), b.size()) < std::min(a.size(), b.size()) * c_intersectBlockRatio)
+                return IntersectMergeSSE2(a, b, out);
+        }
+#endif
+        return IntersectMerge(a, b, out);
+    }
+}
+
+// Writes the values that are in both lists to out, and returns how many there are
+template <typename T>
+size_t Intersect(Span<T> a, Span<T> b, T* out)
+{
+    if (a.empty() || b.empty() || b[b.size() - 1] < a[0] || a[a.size() - 1] < b[0])
+        return 0;
+
+    size_t smaller = std::min(a.size(), b.size());
+    size_t larger = std::max(a.size(), b.size());
+    if (larger < smaller * detail::c_intersectMergeRatio)
+        return detail::IntersectSimilar(a, b, out);
+    return detail::IntersectGallop(a, b, out);
+}
+
+// Writes the values that are in every list to out, and returns how many there are. The two smallest lists are
+// intersected first, and then what's left of them with each of the other lists, in place in out.
+template <typename T>
+size_t Intersect(const Span<T>* lists, size_t numLists, T* out)
+{
+    if (numLists == 0)
+        return 0;
+    if (numLists == 1)
+    {
+        std::copy(lists[0].begin(), lists[0].end(), out);
+        return lists[0].size();
+    }
+
+    size_t smallest = 0;
+    size_t secondSmallest = 1;
+    if (lists[secondSmallest].size() < lists[smallest].size())
+        std::swap(smallest, secondSmallest);
+    for (size_t listIndex = 2; listIndex < numLists; ++listIndex)
+    {
+        if (lists[listIndex].size() < lists[smallest].size())
+        {
+            secondSmallest = smallest;
+            smallest = listIndex;
+        }
+        else if (lists[listIndex].size() < lists[secondSmallest].size())
+            secondSmallest = listIndex;
+    }
+
+    size_t count = Intersect(lists[smallest], lists[secondSmallest], out);
+    for (size_t listIndex = 0; listIndex < numLists && count > 0; ++listIndex)
+    {
+        // out is only written behind where it's read, so it can be the first list
+        if (listIndex != smallest && listIndex != secondSmallest)
+            count = Intersect(Span<T>(out, count), lists[listIndex], out);
+    }
+    return count;
+}
+
+}
@@ -0,0 +1,418 @@
+#pragma once
+
+// A log structured index: writes go to a small hashed buffer, full buffers are sorted into immutable sorted runs, and a
+// background thread merges runs so there are only ever a few of them. Each run carries a BoundedLineFitIndex, so
+// searching a run is a prediction and a small binary search, and a Bloom filter, so most runs that don't have a key
+// are skipped without searching them.
+//
+//   lfs::LogStructuredIndex<uint64_t, uint32_t> index;
+//   index.Insert(key, value);
+//   uint32_t value;
+//   if (index.Find(key, value))
+//       ...
+//
+// Inserting a key that's already there replaces its value. A lookup checks the buffer, then the runs from newest to
+// oldest, so the newest value of a key is the one found. A run is merged into the run before it once it's at least
+// mergeRatio times its size, which keeps the number of runs logarithmic in the number of keys.
+//
+// One thread inserts and finds. The merge thread only ever swaps whole runs, under a lock that lookups take too.
+
+#include "linear_fit_search.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace lfs
+{
+
+namespace detail
+{
+    // A blocked Bloom filter over numeric keys. A 64 bit mix of the key picks a cache line sized block, and every bit
+    // of the key is set in that block, so a lookup touches one cache line however many bits it checks.
+    class BloomFilter
+    {
+        static const size_t c_blockWords = 8;
+
+    public:
+        BloomFilter() {}
+
+        BloomFilter(size_t numKeys, size_t bitsPerKey)
+        {
+            // the block count is a power of two so a block can be picked with a mask
+            size_t numBlocks = 1;
+            while (numBlocks * c_blockWords * 64 < numKeys * bitsPerKey)
+                numBlocks *= 2;
+            m_words.assign(numBlocks * c_blockWords, 0);
+
+            // setting ln 2 * bits per key bits for each key gives the fewest false positives
+            m_numBits = std::max<size_t>(size_t(float(bitsPerKey) * 0.69f), 1);
+        }
+
+        template <typename Key>
+        void Add(const Key& key)
+        {
+            uint64_t hash = Mix(uint64_t(key));
+            uint64_t* block = &m_words[size_t(hash & (m_words.size() / c_blockWords - 1)) * c_blockWords];
+            uint32_t bit = uint32_t(hash >> 32);
+            uint32_t step = uint32_t(hash >> 41) | 1;
+            for (size_t index = 0; index < m_numBits; ++index, bit += step)
+                block[(bit / 64) % c_blockWords] |= uint64_t(1) << (bit % 64);
+        }
+
+        template <typename Key>
+        bool MayContain(const Key& key) const
+        {
+            if (m_words.empty())
+                return false;
+
+            uint64_t hash = Mix(uint64_t(key));
+            const uint64_t* block = &m_words[size_t(hash & (m_words.size() / c_blockWords - 1)) * c_blockWords];
+            uint32_t bit = uint32_t(hash >> 32);
+            uint32_t step = uint32_t(hash >> 41) | 1;
+            for (size_t index = 0; index < m_numBits; ++index, bit += step)
+            {
+                if (!(block[(bit / 64) % c_blockWords] & (uint64_t(1) << (bit % 64))))
+                    return false;
+            }
+            return true;
+        }
+
+        size_t Bytes() const
+        {
+            return m_words.capacity() * sizeof(uint64_t);
+        }
+
+    private:
+        // the SplitMix64 finalizer
+        static uint64_t Mix(uint64_t x)
+        {
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+        std::vector<uint64_t> m_words;
+        size_t m_numBits = 0;
+    };
+
+    // An allocator that adds up the bytes it has out, so the memory of a hash map's nodes and buckets can be reported
+    // without knowing how the standard library lays them out
+    template <typename T>
+    struct CountingAllocator
+    {
+        typedef T value_type;
+
+        size_t* bytes;
+
+        explicit CountingAllocator(size_t* bytes_) : bytes(bytes_) {}
+
+        template <typename U>
+        CountingAllocator(const CountingAllocator<U>& other) : bytes(other.bytes) {}
+
+        T* allocate(size_t count)
+        {
+            *bytes += count * sizeof(T);
+            return std::allocator<T>().allocate(count);
+        }
+
+        void deallocate(T* pointer, size_t count)
+        {
+            *bytes -= count * sizeof(T);
+            std::allocator<T>().deallocate(pointer, count);
+        }
+
+        template <typename U>
+        bool operator==(const CountingAllocator<U>& other) const { return bytes == other.bytes; }
+
+        template <typename U>
+        bool operator!=(const CountingAllocator<U>& other) const { return bytes != other.bytes; }
+    };
+}
+
+template <typename Key, typename Value>
+class LogStructuredIndex
+{
+    static_assert(std::is_arithmetic<Key>::value, "LogStructuredIndex keys have to be numbers, for the line fit");
+
+public:
+    struct Params
+    {
+        size_t bufferKeys = 1024;       // the buffer becomes a run when it has this many keys
+        size_t bloomBitsPerKey = 10;    // about a 1% false positive rate
+        float mergeRatio = 1.0f;        // a run is merged into the older run before it once it's at least this big
+                                        // compared to it. 1 merges like a binary counter adds.
+        bool backgroundMerge = true;    // false merges on the inserting thread, when a buffer becomes a run
+    };
+
+    explicit LogStructuredIndex(const Params& params = Params()) : m_params(params), m_buffer(0, std::hash<Key>(), std::equal_to<Key>(), BufferAllocator(&m_bufferBytes))
+    {
+        Start();
+    }
+
+    // Bulk loads sorted, unique keys as the first run
+    LogStructuredIndex(Span<Key> keys, Span<Value> values, const Params& params = Params())
+        : m_params(params), m_buffer(0, std::hash<Key>(), std::equal_to<Key>(), BufferAllocator(&m_bufferBytes))
+    {
+        if (!keys.empty())
+            m_runs.push_back(MakeRun(std::vector<Key>(keys.begin(), keys.end()), std::vector<Value>(values.begin(), values.end())));
+        Start();
+    }
+
+    LogStructuredIndex(const LogStructuredIndex&) = delete;
+    LogStructuredIndex& operator=(const LogStructuredIndex&) = delete;
+
+    ~LogStructuredIndex()
+    {
+        if (m_mergeThread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_mergeWake.notify_one();
+            m_mergeThread.join();
+        }
+    }
+
+    void Insert(const Key& key, const Value& value)
+    {
+        m_buffer[key] = value;
+        if (m_buffer.size() >= m_params.bufferKeys)
+            Flush();
+    }
+
+    // copies the newest value of the key into value, and returns false if the key isn't there
+    bool Find(const Key& key, Value& value) const
+    {
+        typename Buffer::const_iterator it = m_buffer.find(key);
+        if (it != m_buffer.end())
+        {
+            value = it->second;
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::shared_ptr<const Run>& run : m_runs)
+        {
+            if (!run->filter.MayContain(key))
+                continue;
+            SearchResult result = run->model.Search(key);
+            if (result.found)
+            {
+                value = run->values[result.index];
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Makes the buffer into a run, even if it isn't full
+    void Flush()
+    {
+        if (m_buffer.empty())
+            return;
+
+        std::vector<std::pair<Key, Value>> sorted(m_buffer.begin(), m_buffer.end());
+        std::sort(sorted.begin(), sorted.end(), [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return a.first < b.first; });
+        m_buffer.clear();
+
+        std::vector<Key> keys(sorted.size());
+        std::vector<Value> values(sorted.size());
+        for (size_t index = 0; index < sorted.size(); ++index)
+        {
+            keys[index] = sorted[index].first;
+            values[index] = sorted[index].second;
+        }
+        std::shared_ptr<const Run> run = MakeRun(std::move(keys), std::move(values));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_runs.insert(m_runs.begin(), run);
+            m_flushes++;
+        }
+
+        if (m_params.backgroundMerge)
+            m_mergeWake.notify_one();
+        else
+            MergeRuns();
+    }
+
+    // Waits until the merge thread has nothing left to merge
+    void WaitForMerges()
+    {
+        if (!m_params.backgroundMerge)
+            return;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_mergeIdle.wait(lock, [this]() { return m_mergedFlushes == m_flushes; });
+    }
+
+    size_t NumRuns() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_runs.size();
+    }
+
+    // memory used by the buffer's nodes and buckets, and the runs, with their models and filters
+    size_t Bytes() const
+    {
+        size_t ret = m_bufferBytes;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::shared_ptr<const Run>& run : m_runs)
+            ret += sizeof(Run) + run->keys.capacity() * sizeof(Key) + run->values.capacity() * sizeof(Value) + run->filter.Bytes();
+        return ret;
+    }
+
+private:
+    // an immutable sorted run. The model points into keys, so a run never moves once it's made.
+    struct Run
+    {
+        std::vector<Key> keys;
+        std::vector<Value> values;
+        BoundedLineFitIndex<Key> model;
+        detail::BloomFilter filter;
+
+        Run(std::vector<Key>&& sortedKeys, std::vector<Value>&& sortedValues, size_t bloomBitsPerKey)
+            : keys(std::move(sortedKeys)), values(std::move(sortedValues)), model(Span<Key>(keys)), filter(keys.size(), bloomBitsPerKey)
+        {
+            for (const Key& key : keys)
+                filter.Add(key);
+        }
+    };
+
+    std::shared_ptr<const Run> MakeRun(std::vector<Key>&& keys, std::vector<Value>&& values) const
+    {
+        return std::make_shared<const Run>(std::move(keys), std::move(values), m_params.bloomBitsPerKey);
+    }
+
+    // merges a newer run with an older one. The newer value of a key wins.
+    std::shared_ptr<const Run> MergeTwo(const Run& newer, const Run& older) const
+    {
+        std::vector<Key> keys(newer.keys.size() + older.keys.size());
+        std::vector<Value> values(keys.size());
+
+        size_t newerIndex = 0;
+        size_t olderIndex = 0;
+        size_t count = 0;
+        while (newerIndex < newer.keys.size() && olderIndex < older.keys.size())
+        {
+            const Key& newerKey = newer.keys[newerIndex];
+            const Key& olderKey = older.keys[olderIndex];
+            if (olderKey < newerKey)
+            {
+                keys[count] = olderKey;
+                values[count++] = older.values[olderIndex++];
+            }
+            else
+            {
+                olderIndex += (olderKey == newerKey) ? 1 : 0;
+                keys[count] = newerKey;
+                values[count++] = newer.values[newerIndex++];
+            }
+        }
+        for (; newerIndex < newer.keys.size(); ++newerIndex, ++count)
+        {
+            keys[count] = newer.keys[newerIndex];
+            values[count] = newer.values[newerIndex];
+        }
+        for (; olderIndex < older.keys.size(); ++olderIndex, ++count)
+        {
+            keys[count] = older.keys[olderIndex];
+            values[count] = older.values[olderIndex];
+        }
+
+        // keys in both runs are only kept once
+        keys.resize(count);
+        values.resize(count);
+        return MakeRun(std::move(keys), std::move(values));
+    }
+
+    // Merges pairs of runs until no newer run is big enough to merge into the one before it. The merging itself is
+    // done outside the lock, so lookups and flushes only wait for the swap.
+    void MergeRuns()
+    {
+        while (1)
+        {
+            std::shared_ptr<const Run> newer, older;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (size_t index = 0; index + 1 < m_runs.size(); ++index)
+                {
+                    if (float(m_runs[index]->keys.size()) >= m_params.mergeRatio * float(m_runs[index + 1]->keys.size()))
+                    {
+                        newer = m_runs[index];
+                        older = m_runs[index + 1];
+                        break;
+                    }
+                }
+            }
+            if (!newer)
+                return;
+
+            std::shared_ptr<const Run> merged = MergeTwo(*newer, *older);
+
+            // new runs only ever go on the front, so the pair is still next to each other
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (size_t index = 0; index + 1 < m_runs.size(); ++index)
+            {
+                if (m_runs[index] == newer)
+                {
+                    m_runs[index] = merged;
+                    m_runs.erase(m_runs.begin() + index + 1);
+                    break;
+                }
+            }
+        }
+    }
+
+    void Start()
+    {
+        if (m_params.backgroundMerge)
+            m_mergeThread = std::thread([this]() { MergeThread(); });
+    }
+
+    void MergeThread()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stop)
+        {
+            if (m_mergedFlushes == m_flushes)
+            {
+                m_mergeWake.wait(lock);
+                continue;
+            }
+
+            size_t flushes = m_flushes;
+            lock.unlock();
+            MergeRuns();
+            lock.lock();
+            m_mergedFlushes = flushes;
+            m_mergeIdle.notify_all();
+        }
+    }
+
+    typedef detail::CountingAllocator<std::pair<const Key, Value>> BufferAllocator;
+    typedef std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, BufferAllocator> Buffer;
+
+    Params m_params;
+    size_t m_bufferBytes = 0;                       // what the buffer has allocated. Declared before it, for its allocator.
+    Buffer m_buffer;                                // a hash map, since an insert into a sorted buffer moves half of it
+
+    mutable std::mutex m_mutex;                     // guards everything below
+    std::vector<std::shared_ptr<const Run>> m_runs; // newest first
+    size_t m_flushes = 0;
+    size_t m_mergedFlushes = 0;                     // the flushes the merge thread has merged after
+    bool m_stop = false;
+    std::condition_variable m_mergeWake;
+    std::condition_variable m_mergeIdle;
+    std::thread m_mergeThread;
+};
+
+}
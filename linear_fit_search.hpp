@@ -0,0 +1,743 @@
+#pragma once
+
+// Searches of sorted arrays that guess where a value is by fitting a line to what they know, plus the linear and
+// binary searches they are measured against. Header only, with no dependencies beyond the standard library.
+//
+// Every search takes a Span of sorted values and a key, and returns a SearchResult. If the key isn't found, the index
+// is where the search gave up, which is next to where the key would go.
+//
+//   std::vector<uint32_t> values = ...;
+//   lfs::SearchResult result = lfs::HybridSearch(lfs::Span(values), key);
+//
+// The searches are templates over an instrumentation policy, which defaults to NoInstrumentation. A policy has:
+//
+//   static void Guess(SearchResult& result, size_t count = 1)  - called for every guess (memory read) a search makes
+//   static T Read(Span<T> values, size_t index)                - every read of the values goes through this
+//   static void Window(size_t window)                          - the search window (maxIndex - minIndex) after a step
+//
+// NoInstrumentation does nothing but the read, so it compiles down to just the search. CountGuesses counts guesses.
+//
+// The searches and index classes are constexpr, so a table that is known at compile time can be searched, and indexed,
+// by the compiler:
+//
+//   static constexpr std::array<uint32_t, 4> c_table = { 10, 20, 40, 80 };
+//   static constexpr lfs::BoundedLineFitIndex<uint32_t> c_index{ lfs::Span(c_table) };
+//   static_assert(c_index.Search(40).found, "");
+
+#include <stddef.h>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
+
+namespace lfs
+{
+
+// A read only view of contiguous values
+template <typename T>
+class Span
+{
+public:
+    using value_type = T;
+
+    constexpr Span() : m_data(nullptr), m_size(0) {}
+    constexpr Span(const T* data, size_t size) : m_data(data), m_size(size) {}
+    Span(const std::vector<T>& values) : m_data(values.data()), m_size(values.size()) {}
+    template <size_t N>
+    constexpr Span(const T (&values)[N]) : m_data(values), m_size(N) {}
+    template <size_t N>
+    constexpr Span(const std::array<T, N>& values) : m_data(values.data()), m_size(N) {}
+
+    constexpr const T* data() const { return m_data; }
+    constexpr size_t size() const { return m_size; }
+    constexpr bool empty() const { return m_size == 0; }
+    constexpr const T* begin() const { return m_data; }
+    constexpr const T* end() const { return m_data + m_size; }
+    constexpr const T& operator[](size_t index) const { return m_data[index]; }
+
+private:
+    const T* m_data;
+    size_t m_size;
+};
+
+template <typename T>
+Span(const std::vector<T>&) -> Span<T>;
+template <typename T, size_t N>
+Span(const std::array<T, N>&) -> Span<T>;
+
+struct SearchResult
+{
+    bool found;
+    size_t index;
+    size_t guesses;     // only counted by CountGuesses
+};
+
+// just searches
+struct NoInstrumentation
+{
+    static constexpr void Guess(SearchResult&, size_t = 1)
+    {
+    }
+
+    template <typename T>
+    static constexpr T Read(Span<T> values, size_t index)
+    {
+        return values[index];
+    }
+
+    static constexpr void Window(size_t)
+    {
+    }
+};
+
+// counts guesses
+struct CountGuesses
+{
+    static constexpr void Guess(SearchResult& result, size_t count = 1)
+    {
+        result.guesses += count;
+    }
+
+    template <typename T>
+    static constexpr T Read(Span<T> values, size_t index)
+    {
+        return values[index];
+    }
+
+    static constexpr void Window(size_t)
+    {
+    }
+};
+
+namespace detail
+{
+    template <typename T>
+    constexpr T Clamp(T min, T max, T value)
+    {
+        if (value < min)
+            return min;
+        else if (value > max)
+            return max;
+        else
+            return value;
+    }
+
+    constexpr SearchResult MakeResult(bool found, size_t index)
+    {
+        SearchResult ret = { found, index, 0 };
+        return ret;
+    }
+
+    // The line fit search, once the values at both ends are known
+    template <typename TPolicy, typename T>
+    constexpr SearchResult LineFitBetween(Span<T> values, const T& key, T min, T max)
+    {
+        size_t minIndex = 0;
+        size_t maxIndex = values.size() - 1;
+
+        SearchResult ret = MakeResult(true, 0);
+
+        // if we've already found the value, we are done
+        if (key < min)
+        {
+            ret.index = minIndex;
+            ret.found = false;
+            return ret;
+        }
+        if (key > max)
+        {
+            ret.index = maxIndex;
+            ret.found = false;
+            return ret;
+        }
+        if (key == min)
+        {
+            ret.index = minIndex;
+            return ret;
+        }
+        if (key == max)
+        {
+            ret.index = maxIndex;
+            return ret;
+        }
+
+        // fit a line to the end points
+        // y = mx + b
+        // m = rise / run
+        // b = y - mx
+        float m = (float(max) - float(min)) / float(maxIndex - minIndex);
+        float b = float(min) - m * float(minIndex);
+        TPolicy::Window(maxIndex - minIndex);
+
+        while (1)
+        {
+            // make a guess based on our line fit
+            TPolicy::Guess(ret);
+            size_t guessIndex = size_t(0.5f + (float(key) - b) / m);
+            guessIndex = Clamp(minIndex + 1, maxIndex - 1, guessIndex);
+            T guess = TPolicy::Read(values, guessIndex);
+
+            // if we found it, return success
+            if (guess == key)
+            {
+                ret.index = guessIndex;
+                return ret;
+            }
+
+            // if we were too low, this is our new minimum
+            if (guess < key)
+            {
+                minIndex = guessIndex;
+                min = guess;
+            }
+            // else we were too high, this is our new maximum
+            else
+            {
+                maxIndex = guessIndex;
+                max = guess;
+            }
+
+            // if we run out of places to look, we didn't find it
+            if (minIndex + 1 >= maxIndex)
+            {
+                ret.index = minIndex;
+                ret.found = false;
+                return ret;
+            }
+            TPolicy::Window(maxIndex - minIndex);
+
+            // fit a new line
+            m = (float(max) - float(min)) / float(maxIndex - minIndex);
+            b = float(min) - m * float(minIndex);
+        }
+
+        return ret;
+    }
+}
+
+template <typename TPolicy = NoInstrumentation, typename T>
+constexpr SearchResult LinearSearch(Span<T> values, const typename Span<T>::value_type& key)
+{
+    SearchResult ret = detail::MakeResult(false, 0);
+
+    while (1)
+    {
+        if (ret.index >= values.size())
+            break;
+        TPolicy::Guess(ret);
+
+        T value = TPolicy::Read(values, ret.index);
+        if (value == key)
+        {
+            ret.found = true;
+            break;
+        }
+        if (value > key)
+            break;
+
+        ret.index++;
+    }
+
+    return ret;
+}
+
+// The idea of this search is that we keep a fit of a line y=mx+b
+// of the left and right side known data points, and use that
+// info to make a guess as to where the value will be.
+//
+// When a guess is wrong, it becomes the new left or right of the line
+// depending on if it was too low (left) or too high (right).
+//
+// The guess count doesn't include the min and max reads at the beginning
+// because those could reasonably be done in advance, which is what
+// LineFitIndex does.
+template <typename TPolicy = NoInstrumentation, typename T>
+constexpr SearchResult LineFitSearch(Span<T> values, const typename Span<T>::value_type& key)
+{
+    if (values.empty())
+        return detail::MakeResult(false, 0);
+
+    // get the starting min and max value.
+    T min = TPolicy::Read(values, 0);
+    T max = TPolicy::Read(values, values.size() - 1);
+    return detail::LineFitBetween<TPolicy>(values, key, min, max);
+}
+
+// The knobs of the hybrid search. The defaults are a strict 1:1 alternation of line fit and binary search steps, with
+// no guard and no linear finish.
+struct HybridParams
+{
+    size_t lineFitSteps = 1;            // line fit steps per binary search step
+    size_t linearFinishThreshold = 0;   // once the window is this small or smaller, finish with a linear search
+    size_t guardWidth = 0;              // after a line fit step, also read this far past the guess towards the value
+};
+
+namespace detail
+{
+    // The hybrid search with the linear finish and the guard compiled in only when they're used, so that the steps of
+    // the default alternation don't check for them
+    template <bool LinearFinish, bool Guard, typename TPolicy, typename T>
+    constexpr SearchResult HybridSearch(Span<T> values, const typename Span<T>::value_type& key, const HybridParams& params)
+    {
+        if (values.empty())
+            return detail::MakeResult(false, 0);
+
+        // get the starting min and max value.
+        size_t minIndex = 0;
+        size_t maxIndex = values.size() - 1;
+        T min = TPolicy::Read(values, minIndex);
+        T max = TPolicy::Read(values, maxIndex);
+
+        SearchResult ret = detail::MakeResult(true, 0);
+
+        // if we've already found the value, we are done
+        if (key < min)
+        {
+            ret.index = minIndex;
+            ret.found = false;
+            return ret;
+        }
+        if (key > max)
+        {
+            ret.index = maxIndex;
+            ret.found = false;
+            return ret;
+        }
+        if (key == min)
+        {
+            ret.index = minIndex;
+            return ret;
+        }
+        if (key == max)
+        {
+            ret.index = maxIndex;
+            return ret;
+        }
+
+        // fit a line to the end points
+        // y = mx + b
+        // m = rise / run
+        // b = y - mx
+        float m = (float(max) - float(min)) / float(maxIndex - minIndex);
+        float b = float(min) - m * float(minIndex);
+        TPolicy::Window(maxIndex - minIndex);
+
+        size_t lineFitStepsDone = 0;
+        while (1)
+        {
+            // when there are only a few places left to look, walk through them
+            if (LinearFinish && maxIndex - minIndex <= params.linearFinishThreshold)
+            {
+                for (size_t index = minIndex + 1; index < maxIndex; ++index)
+                {
+                    TPolicy::Guess(ret);
+                    T value = TPolicy::Read(values, index);
+                    if (value == key)
+                    {
+                        ret.index = index;
+                        return ret;
+                    }
+                    if (value > key)
+                        break;
+                    minIndex = index;
+                }
+                ret.index = minIndex;
+                ret.found = false;
+                return ret;
+            }
+
+            // make a guess based on our line fit, or by binary search once enough line fit steps are done
+            bool doBinaryStep = lineFitStepsDone >= params.lineFitSteps;
+            TPolicy::Guess(ret);
+            size_t guessIndex = doBinaryStep ? (minIndex + maxIndex) / 2 : size_t(0.5f + (float(key) - b) / m);
+            guessIndex = detail::Clamp(minIndex + 1, maxIndex - 1, guessIndex);
+            T guess = TPolicy::Read(values, guessIndex);
+
+            // if we found it, return success
+            if (guess == key)
+            {
+                ret.index = guessIndex;
+                return ret;
+            }
+
+            // if we were too low, this is our new minimum
+            if (guess < key)
+            {
+                minIndex = guessIndex;
+                min = guess;
+            }
+            // else we were too high, this is our new maximum
+            else
+            {
+                maxIndex = guessIndex;
+                max = guess;
+            }
+
+            // A line fit guess usually lands close to the value, but on the same side of it again and again. Reading a
+            // little past the guess can move the other end of the window in close too.
+            if (Guard && !doBinaryStep)
+            {
+                size_t guardIndex = guess < key ? minIndex + params.guardWidth : maxIndex - std::min(maxIndex, params.guardWidth);
+                if (guardIndex > minIndex && guardIndex < maxIndex)
+                {
+                    TPolicy::Guess(ret);
+                    T guard = TPolicy::Read(values, guardIndex);
+                    if (guard == key)
+                    {
+                        ret.index = guardIndex;
+                        return ret;
+                    }
+                    if (guard < key)
+                    {
+                        minIndex = guardIndex;
+                        min = guard;
+                    }
+                    else
+                    {
+                        maxIndex = guardIndex;
+                        max = guard;
+                    }
+                }
+            }
+
+            // if we run out of places to look, we didn't find it
+            if (minIndex + 1 >= maxIndex)
+            {
+                ret.index = minIndex;
+                ret.found = false;
+                return ret;
+            }
+            TPolicy::Window(maxIndex - minIndex);
+
+            // fit a new line
+            m = (float(max) - float(min)) / float(maxIndex - minIndex);
+            b = float(min) - m * float(minIndex);
+
+            // move on to the next step of the pattern
+            lineFitStepsDone = doBinaryStep ? 0 : lineFitStepsDone + 1;
+        }
+
+        return ret;
+    }
+}
+
+// Does params.lineFitSteps line fit steps, then a binary search step, and repeats.
+// Line fit can do better than binary search, but it can also get trapped in situations that it does poorly.
+// The binary search step is there to help it break out of those situations.
+template <typename TPolicy = NoInstrumentation, typename T>
+constexpr SearchResult HybridSearch(Span<T> values, const typename Span<T>::value_type& key, const HybridParams& params = HybridParams())
+{
+    if (params.linearFinishThreshold > 0)
+    {
+        return params.guardWidth > 0
+            ? detail::HybridSearch<true, true, TPolicy>(values, key, params)
+            : detail::HybridSearch<true, false, TPolicy>(values, key, params);
+    }
+    return params.guardWidth > 0
+        ? detail::HybridSearch<false, true, TPolicy>(values, key, params)
+        : detail::HybridSearch<false, false, TPolicy>(values, key, params);
+}
+
+template <typename TPolicy = NoInstrumentation, typename T>
+constexpr SearchResult BinarySearch(Span<T> values, const typename Span<T>::value_type& key)
+{
+    SearchResult ret = detail::MakeResult(false, 0);
+    if (values.empty())
+        return ret;
+
+    size_t minIndex = 0;
+    size_t maxIndex = values.size()-1;
+    TPolicy::Window(maxIndex - minIndex);
+    while (1)
+    {
+        // make a guess by looking in the middle of the unknown area
+        TPolicy::Guess(ret);
+        size_t guessIndex = (minIndex + maxIndex) / 2;
+        T guess = TPolicy::Read(values, guessIndex);
+
+        // found it
+        if (guess == key)
+        {
+            ret.found = true;
+            ret.index = guessIndex;
+            return ret;
+        }
+        // if our guess was too low, it's the new min
+        else if (guess < key)
+        {
+            minIndex = guessIndex + 1;
+        }
+        // if our guess was too high, it's the new max
+        else if (guess > key)
+        {
+            // underflow prevention
+            if (guessIndex == 0)
+            {
+                ret.index = guessIndex;
+                return ret;
+            }
+            maxIndex = guessIndex - 1;
+        }
+
+        // fail case
+        if (minIndex > maxIndex)
+        {
+            ret.index = guessIndex;
+            return ret;
+        }
+        TPolicy::Window(maxIndex - minIndex);
+    }
+
+    return ret;
+}
+
+namespace detail
+{
+    // how many halving steps a branchless binary search of n values takes
+    constexpr size_t FixedSearchSteps(size_t n)
+    {
+        size_t steps = 0;
+        while (n > 1)
+        {
+            n -= n / 2;
+            ++steps;
+        }
+        return steps;
+    }
+
+    // how far the step'th halving step of a branchless binary search of n values looks ahead
+    constexpr size_t FixedSearchHalf(size_t n, size_t step)
+    {
+        while (step-- > 0)
+            n -= n / 2;
+        return n / 2;
+    }
+
+    template <size_t N, typename TPolicy, typename T, size_t... Steps>
+    constexpr size_t FixedBinarySearchBase(Span<T> values, const T& key, SearchResult& ret, std::index_sequence<Steps...>)
+    {
+        // a single value has no steps, and so no reads
+        (void)values;
+        size_t base = 0;
+        ((TPolicy::Guess(ret),
+            base = TPolicy::Read(values, base + std::integral_constant<size_t, FixedSearchHalf(N, Steps)>::value) <= key
+                ? base + std::integral_constant<size_t, FixedSearchHalf(N, Steps)>::value
+                : base), ...);
+        return base;
+    }
+}
+
+// A binary search of exactly N values, for small blocks of keys whose size is known at compile time. Every split point
+// is a compile time constant and there are no loops, so the whole search is log2(N) reads and conditional moves, and
+// then a read to check the value it ended on. values points at N sorted values.
+template <size_t N, typename TPolicy = NoInstrumentation, typename T>
+constexpr SearchResult FixedBinarySearch(const T* values, const typename Span<T>::value_type& key)
+{
+    static_assert(N > 0, "FixedBinarySearch needs at least one value");
+    Span<T> span(values, N);
+    SearchResult ret = detail::MakeResult(false, 0);
+    ret.index = detail::FixedBinarySearchBase<N, TPolicy>(span, key, ret, std::make_index_sequence<detail::FixedSearchSteps(N)>());
+    TPolicy::Guess(ret);
+    ret.found = TPolicy::Read(span, ret.index) == key;
+    return ret;
+}
+
+// A line fit search of exactly N values. It does LineFitSteps line fit steps, then finishes the window that's left
+// with a branchless binary search. The finish always takes as many steps as a binary search of all N values would, so
+// that it has a fixed trip count the compiler can unroll. Steps that have nothing left to halve read the same value
+// again, and aren't counted as guesses. values points at N sorted values.
+template <size_t N, size_t LineFitSteps = 2, typename TPolicy = NoInstrumentation, typename T>
+constexpr SearchResult FixedLineFitSearch(const T* values, const typename Span<T>::value_type& key)
+{
+    static_assert(N > 0, "FixedLineFitSearch needs at least one value");
+    Span<T> span(values, N);
+
+    size_t minIndex = 0;
+    size_t maxIndex = N - 1;
+    T min = TPolicy::Read(span, minIndex);
+    T max = TPolicy::Read(span, maxIndex);
+
+    SearchResult ret = detail::MakeResult(false, 0);
+    if (key <= min || key >= max)
+    {
+        ret.index = key <= min ? minIndex : maxIndex;
+        ret.found = key == min || key == max;
+        return ret;
+    }
+
+    for (size_t step = 0; step < LineFitSteps && minIndex + 1 < maxIndex; ++step)
+    {
+        TPolicy::Guess(ret);
+        float m = (float(max) - float(min)) / float(maxIndex - minIndex);
+        size_t guessIndex = minIndex + size_t(0.5f + (float(key) - float(min)) / m);
+        guessIndex = detail::Clamp(minIndex + 1, maxIndex - 1, guessIndex);
+        T guess = TPolicy::Read(span, guessIndex);
+        if (guess == key)
+        {
+            ret.index = guessIndex;
+            ret.found = true;
+            return ret;
+        }
+        if (guess < key)
+        {
+            minIndex = guessIndex;
+            min = guess;
+        }
+        else
+        {
+            maxIndex = guessIndex;
+            max = guess;
+        }
+    }
+
+    // the value is after minIndex and before maxIndex, if it's there at all
+    size_t base = minIndex;
+    size_t count = maxIndex - minIndex;
+    for (size_t step = 0; step < detail::FixedSearchSteps(N); ++step)
+    {
+        size_t half = count / 2;
+        if (half > 0)
+            TPolicy::Guess(ret);
+        base = TPolicy::Read(span, base + half) <= key ? base + half : base;
+        count -= half;
+    }
+    ret.index = base;
+    ret.found = TPolicy::Read(span, base) == key;
+    return ret;
+}
+
+// A line fit search that reads the values at both ends once, when it's made, instead of at the start of every search.
+// The values must outlive the index and not change under it.
+template <typename T>
+class LineFitIndex
+{
+public:
+    constexpr explicit LineFitIndex(Span<T> values) : m_values(values)
+    {
+        if (!values.empty())
+        {
+            m_min = values[0];
+            m_max = values[values.size() - 1];
+        }
+    }
+
+    template <typename TPolicy = NoInstrumentation>
+    constexpr SearchResult Search(const T& key) const
+    {
+        if (m_values.empty())
+            return detail::MakeResult(false, 0);
+        return detail::LineFitBetween<TPolicy>(m_values, key, m_min, m_max);
+    }
+
+    constexpr Span<T> Values() const
+    {
+        return m_values;
+    }
+
+private:
+    Span<T> m_values;
+    T m_min = T();
+    T m_max = T();
+};
+
+// Fits a line to the values when it's made, and keeps how far the line is from any of them. A search reads nothing to
+// make its guess, and then binary searches the window the error bound leaves. Made in a constant expression, the line
+// and its error bound are worked out by the compiler. The values must outlive the index and not change under it.
+template <typename T>
+class BoundedLineFitIndex
+{
+public:
+    constexpr explicit BoundedLineFitIndex(Span<T> values) : m_values(values)
+    {
+        if (values.empty())
+            return;
+
+        m_min = values[0];
+        m_max = values[values.size() - 1];
+        if (m_max > m_min)
+            m_scale = float(values.size() - 1) / (float(m_max) - float(m_min));
+
+        for (size_t index = 0; index < values.size(); ++index)
+        {
+            size_t predicted = Predict(values[index]);
+            size_t error = predicted > index ? predicted - index : index - predicted;
+            m_maxError = std::max(m_maxError, error);
+        }
+
+        // a key that isn't in the values predicts somewhere between its neighbors
+        m_maxError++;
+    }
+
+    template <typename TPolicy = NoInstrumentation>
+    constexpr SearchResult Search(const T& key) const
+    {
+        if (m_values.empty())
+            return detail::MakeResult(false, 0);
+        if (key <= m_min || key >= m_max)
+            return detail::MakeResult(key == m_min || key == m_max, key <= m_min ? 0 : m_values.size() - 1);
+
+        size_t predicted = Predict(key);
+        size_t minIndex = predicted > m_maxError ? predicted - m_maxError : 0;
+        size_t maxIndex = std::min(predicted + m_maxError, m_values.size() - 1);
+        TPolicy::Window(maxIndex - minIndex);
+
+        SearchResult ret = BinarySearch<TPolicy>(Span<T>(m_values.data() + minIndex, maxIndex - minIndex + 1), key);
+        ret.index += minIndex;
+        return ret;
+    }
+
+    // where the line puts a key, clamped to the values
+    constexpr size_t Predict(const T& key) const
+    {
+        if (key <= m_min)
+            return 0;
+        // at or past the end, since repeated values give more than an index per unit and the float outgrows a size_t
+        if (!(key < m_max))
+            return m_values.size() - 1;
+        return std::min(size_t(0.5f + (float(key) - float(m_min)) * m_scale), m_values.size() - 1);
+    }
+
+    // how far a search may have to look from the index the line predicts
+    constexpr size_t MaxError() const
+    {
+        return m_maxError;
+    }
+
+    constexpr Span<T> Values() const
+    {
+        return m_values;
+    }
+
+private:
+    Span<T> m_values;
+    T m_min = T();
+    T m_max = T();
+    float m_scale = 0.0f;   // indices per unit of value
+    size_t m_maxError = 0;
+};
+
+// A hybrid search with its parameters, for example ones tuned for a particular set of values
+template <typename T>
+class HybridIndex
+{
+public:
+    constexpr HybridIndex(Span<T> values, const HybridParams& params = HybridParams()) : m_values(values), m_params(params) {}
+
+    template <typename TPolicy = NoInstrumentation>
+    constexpr SearchResult Search(const T& key) const
+    {
+        return HybridSearch<TPolicy>(m_values, key, m_params);
+    }
+
+    constexpr const HybridParams& Params() const
+    {
+        return m_params;
+    }
+
+private:
+    Span<T> m_values;
+    HybridParams m_params;
+};
+
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+// An index of timestamps that only ever get appended, in order. It keeps a piecewise linear model of where each
+// timestamp is, which it extends as timestamps come in instead of fitting it again, so an append is O(1).
+//
+//   lfs::TimeSeriesIndex<uint64_t> index;
+//   index.Append(timestamp);
+//   lfs::SearchResult floor = index.Floor(time);   // the last timestamp at or before time
+//   lfs::SearchResult ceil = index.Ceil(time);     // the first timestamp at or after time
+//
+// The model is made of segments, each a line from a first timestamp that predicts the index of every timestamp in it
+// to within MaxError(). A segment is grown with the shrinking cone method (O'Rourke, and FITing-tree): the slopes
+// that keep every timestamp so far within the error make a cone, each append narrows it, and when an append would
+// leave the cone empty, a new segment starts there. A lookup finds its segment, predicts the index from the line and
+// only has to search the window the error leaves.
+
+#include "linear_fit_search.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+namespace lfs
+{
+
+template <typename T>
+class TimeSeriesIndex
+{
+    static_assert(std::is_arithmetic<T>::value, "TimeSeriesIndex timestamps have to be numbers, for the line fit");
+
+public:
+    explicit TimeSeriesIndex(size_t maxError = 16) : m_maxError(std::max<size_t>(maxError, 1)) {}
+
+    size_t Size() const
+    {
+        return m_values.size();
+    }
+
+    size_t NumSegments() const
+    {
+        return m_segments.size();
+    }
+
+    size_t MaxError() const
+    {
+        return m_maxError;
+    }
+
+    Span<T> Values() const
+    {
+        return Span<T>(m_values);
+    }
+
+    // memory used by the timestamps and the segments
+    size_t Bytes() const
+    {
+        return m_values.capacity() * sizeof(T) + m_segments.capacity() * sizeof(Segment);
+    }
+
+    // Returns false, and doesn't append, if the timestamp is before the last one
+    bool Append(const T& value)
+    {
+        if (!m_values.empty() && value < m_values.back())
+            return false;
+
+        size_t index = m_values.size();
+        m_values.push_back(value);
+
+        if (!m_segments.empty())
+        {
+            Segment& segment = m_segments.back();
+            double dy = double(index - segment.first);
+            double dx = double(value - segment.firstValue);
+
+            // a repeat of the first timestamp doesn't change the slopes, but can only be so far from it
+            if (dx <= 0.0)
+            {
+                if (dy <= double(m_maxError))
+                    return true;
+            }
+            else
+            {
+                double slopeLow = std::max(segment.slopeLow, (dy - double(m_maxError)) / dx);
+                double slopeHigh = std::min(segment.slopeHigh, (dy + double(m_maxError)) / dx);
+                if (slopeLow <= slopeHigh)
+                {
+                    segment.slopeLow = slopeLow;
+                    segment.slopeHigh = slopeHigh;
+                    return true;
+                }
+            }
+        }
+
+        Segment segment;
+        segment.first = index;
+        segment.firstValue = value;
+        m_segments.push_back(segment);
+        return true;
+    }
+
+    // the last timestamp at or before value. Not found if every timestamp is after it.
+    SearchResult Floor(const T& value) const
+    {
+        size_t upper = UpperBound(value);
+        return detail::MakeResult(upper > 0, upper > 0 ? upper - 1 : 0);
+    }
+
+    // the first timestamp at or after value. Not found if every timestamp is before it.
+    SearchResult Ceil(const T& value) const
+    {
+        size_t lower = LowerBound(value);
+        if (lower < m_values.size())
+            return detail::MakeResult(true, lower);
+        return detail::MakeResult(false, m_values.empty() ? 0 : m_values.size() - 1);
+    }
+
+private:
+    struct Segment
+    {
+        size_t first = 0;       // the index of the first timestamp of the segment
+        T firstValue = T();
+        double slopeLow = 0.0;  // the slopes that keep every timestamp of the segment within the error
+        double slopeHigh = std::numeric_limits<double>::infinity();
+    };
+
+    // the first index whose timestamp is after value
+    size_t UpperBound(const T& value) const
+    {
+        size_t minIndex, maxIndex;
+        Window(value, minIndex, maxIndex);
+        return size_t(std::upper_bound(m_values.begin() + minIndex, m_values.begin() + maxIndex, value) - m_values.begin());
+    }
+
+    // the first index whose timestamp isn't before value
+    size_t LowerBound(const T& value) const
+    {
+        size_t minIndex, maxIndex;
+        Window(value, minIndex, maxIndex);
+        return size_t(std::lower_bound(m_values.begin() + minIndex, m_values.begin() + maxIndex, value) - m_values.begin());
+    }
+
+    // The indices [minIndex, maxIndex] that the lower and upper bounds of value are in
+    void Window(const T& value, size_t& minIndex, size_t& maxIndex) const
+    {
+        minIndex = 0;
+        maxIndex = m_values.size();
+        if (m_segments.empty())
+            return;
+
+        // Most lookups of a time series are for recent times, so the current segment is checked before searching
+        // the others. A time that repeats across segments could have its bounds in any of them, so those search
+        // every segment it's in.
+        size_t segmentIndex = m_segments.size() - 1;
+        if (value <= m_segments[segmentIndex].firstValue)
+        {
+            typename std::vector<Segment>::const_iterator it = std::upper_bound(m_segments.begin(), m_segments.end(), value,
+                [](const T& v, const Segment& segment) { return v < segment.firstValue; });
+            if (it == m_segments.begin())
+            {
+                maxIndex = 0;
+                return;
+            }
+            segmentIndex = size_t(it - m_segments.begin()) - 1;
+            if (segmentIndex > 0 && m_segments[segmentIndex].firstValue == value)
+                return;
+        }
+
+        const Segment& segment = m_segments[segmentIndex];
+        size_t segmentEnd = segmentIndex + 1 < m_segments.size() ? m_segments[segmentIndex + 1].first : m_values.size();
+        if (value == segment.firstValue)
+        {
+            // every repeat of the first timestamp is within the error of it
+            minIndex = segment.first;
+            maxIndex = std::min(segment.first + m_maxError + 1, segmentEnd);
+            return;
+        }
+
+        // a value between two timestamps predicts between their indices, so the window is one wider than the error
+        double slope = segment.slopeHigh == std::numeric_limits<double>::infinity() ? segment.slopeLow : (segment.slopeLow + segment.slopeHigh) / 2.0;
+        double predicted = double(segment.first) + slope * double(value - segment.firstValue);
+        double low = predicted - double(m_maxError) - 1.0;
+        double high = predicted + double(m_maxError) + 2.0;
+        minIndex = low <= double(segment.first) ? segment.first : std::min(size_t(low), segmentEnd);
+        maxIndex = high >= double(segmentEnd) ? segmentEnd : std::max(size_t(high), minIndex);
+    }
+
+    std::vector<T> m_values;
+    std::vector<Segment> m_segments;
+    size_t m_maxError;
+};
+
+}
@@ -3,39 +3,190 @@
 #include <random>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <algorithm>
 #include <string>
+#include <map>
+#include <set>
+#include <iterator>
+#include <limits>
 #include <chrono>
+#include <charconv>
+#include <memory>
+#include <stdint.h>
+#include <string.h>
+
+#include "linear_fit_search.hpp"
+#include "linear_fit_flat_map.hpp"
+#include "linear_fit_gapped_index.hpp"
+#include "linear_fit_intersect.hpp"
+#include "linear_fit_lsm_index.hpp"
+#include "linear_fit_time_series.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define LFS_HAS_RDTSCP() 1
+#else
+#define LFS_HAS_RDTSCP() 0
+#endif
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#if LFS_HAS_RDTSCP()
+#include <x86intrin.h>
+#endif
+#endif
 
 static const size_t c_maxValue = 2000;           // the sorted arrays will have values between 0 and this number in them (inclusive)
 static const size_t c_maxNumValues = 1000;       // the graphs will graph between 1 and this many values in a sorted array
-static const size_t c_numRunsPerTest = 100;      // how many times does it do the same test to gather min, max, average?
+static const size_t c_numRunsPerTest = 100;      // how many times does it do the same test to gather min, max, average, etc?
 static const size_t c_perfTestNumSearches = 100000; // how many searches are going to be done per list type, to come up with timing for a search type.
+static const size_t c_sweepTaskNumValues = 50;   // how many sample counts a single task of the csv sweep handles
+static const size_t c_cacheLineSize = 64;        // default bytes per cache line, for the probe trace metrics and the cache simulator
+static const size_t c_pageSize = 4096;           // default bytes per page, for the probe trace metrics and the cache simulator
+static const size_t c_perfTestWarmupRuns = 1;    // untimed passes over the searches before timing a search type
+static const size_t c_perfTestTimedRuns = 5;     // timed passes over the searches. The median pass is reported.
+static const size_t c_tuneNumSearches = 10000;   // how many of the searches the tuner times each set of hybrid parameters with
+static const size_t c_bootstrapResamples = 2000; // resamples for the confidence intervals of the regression gate
+static const size_t c_tuneTimedRuns = 3;         // timed passes per set of hybrid parameters. The median pass is used.
+static const size_t c_blockIndexLeafKeys = 256;  // keys per leaf of the B+ tree the gapped index is timed against
+static const size_t c_updateTestBufferDivisor = 16; // the LSM index of the update test flushes its buffer every this fraction of the bulk loaded keys, so that it flushes and merges at every size
+static const size_t c_timeSeriesMaxRegenerate = 10000; // the time series test only times making the whole list again after every append up to this size
+static const size_t c_intersectMaxLists = 3;     // the intersect test times intersections of two lists, and of up to this many
+static const size_t c_intersectLargeNumValues = 100000; // the intersect test also runs at this size by default, so its largest size ratios leave values in the smaller list
+static const size_t c_intersectMinSmallerValues = 8; // size ratios that would leave fewer values than this in the smaller list are skipped
 
-#define VERIFY_RESULT() 1 // verifies that the search functions got the right answer. prints out a message if they didn't.
-#define MAKE_CSVS() 1 // the main test
+using TestResults = lfs::SearchResult;
 
-struct TestResults
+// SplitMix64. Tiny and fast, and each seed gives its own well mixed stream, so every task of the sweep can derive its
+// own generator from the master seed. That makes a run reproducible from its seed regardless of thread scheduling,
+// and lets any single cell of the sweep be re-run on its own.
+struct RNG
 {
-    bool found;
-    size_t index;
-    size_t guesses;
+    uint64_t state;
+
+    explicit RNG(uint64_t seed) : state(seed) {}
+
+    uint64_t Next()
+    {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // returns a value between min and max inclusive. Uses a modulus rather than std::uniform_int_distribution so
+    // that the same seed gives the same numbers with every standard library.
+    size_t Range(size_t min, size_t max)
+    {
+        return min + size_t(Next() % uint64_t(max - min + 1));
+    }
 };
 
-using MakeListFn = void(*)(std::vector<size_t>& values, size_t count);
+// makes the seed of an independent stream, identified by a key, from a parent seed
+uint64_t DeriveSeed(uint64_t seed, uint64_t key)
+{
+    RNG rng(seed ^ (key * 0xD1B54A32D192ED03ull));
+    rng.Next();
+    return rng.Next();
+}
+
+using MakeListFn = void(*)(std::vector<size_t>& values, size_t count, RNG& rng);
 using TestListFn = TestResults(*)(const std::vector<size_t>& values, size_t searchValue);
 
+// What an engine builds from a list before it can search it, for engines that need more than the sorted list. The
+// search function finds it in t_searchIndex, which is set by whoever built it for as long as the searches run.
+struct SearchIndex
+{
+    virtual ~SearchIndex() {}
+
+    // memory used on top of the list itself
+    virtual size_t Bytes() const = 0;
+};
+
+using BuildFn = std::unique_ptr<SearchIndex>(*)(const std::vector<size_t>& values);
+
+thread_local const SearchIndex* t_searchIndex = nullptr;
+
+// Does every search of a list of search values, throwing the results away. Used for timing.
+using SearchPassFn = void(*)(const std::vector<size_t>& values, const size_t* searchValues, size_t count);
+
+// The search function is a template argument rather than a pointer, so it gets inlined into the loop and a pass costs
+// one indirect call rather than one per search. Defined with the timing code.
+template <TestListFn Search>
+void SearchPass(const std::vector<size_t>& values, const size_t* searchValues, size_t count);
+
 struct MakeListInfo
 {
     const char* name;
     MakeListFn fn;
+    bool deterministic; // true if the list only depends on the count, so it can be made once and reused
 };
 
+// Each search function is registered in three builds, see the search policies
 struct TestListInfo
 {
     const char* name;
-    TestListFn fn;
+    TestListFn fn;              // counts guesses
+    TestListFn tracedFn;        // counts guesses and records every read
+    SearchPassFn productionPass; // only searches, for timing
+    BuildFn build;              // nullptr if the engine searches the list as it is
+};
+
+// The number sequences and search functions register themselves with these, in the order they should show up in
+// the csvs. The command line picks which of them a run uses.
+std::vector<MakeListInfo>& MakeListRegistry()
+{
+    static std::vector<MakeListInfo> s_registry;
+    return s_registry;
+}
+
+std::vector<TestListInfo>& TestListRegistry()
+{
+    static std::vector<TestListInfo> s_registry;
+    return s_registry;
+}
+
+struct MakeListRegistrar
+{
+    MakeListRegistrar(const char* name, MakeListFn fn, bool deterministic)
+    {
+        MakeListRegistry().push_back({ name, fn, deterministic });
+    }
 };
 
+struct TestListRegistrar
+{
+    TestListRegistrar(const char* name, TestListFn fn, TestListFn tracedFn, SearchPassFn productionPass, BuildFn build)
+    {
+        TestListRegistry().push_back({ name, fn, tracedFn, productionPass, build });
+    }
+};
+
+#define REGISTER_MAKE_LIST(name, fn, deterministic) static MakeListRegistrar s_makeListRegistrar_##fn(name, fn, deterministic);
+#define REGISTER_TEST_LIST(name, fn) static TestListRegistrar s_testListRegistrar_##fn(name, fn<SearchPolicy_Count>, fn<SearchPolicy_Trace>, SearchPass<fn<SearchPolicy_None>>, nullptr);
+#define REGISTER_INDEXED_TEST_LIST(name, fn, build) static TestListRegistrar s_testListRegistrar_##fn(name, fn<SearchPolicy_Count>, fn<SearchPolicy_Trace>, SearchPass<fn<SearchPolicy_None>>, build);
+
+// FNV-1a, for keying random streams by name
+uint64_t HashName(const char* name)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (const char* c = name; *c; ++c)
+        hash = (hash ^ uint8_t(*c)) * 0x100000001B3ull;
+    return hash;
+}
+
 #define countof(array) (sizeof(array) / sizeof(array[0]))
 
 template <typename T>
@@ -49,29 +200,225 @@ T Clamp(T min, T max, T value)
         return value;
 }
 
-float Lerp(float a, float b, float t)
+// How many searches took each number of guesses. Guess counts below c_histogramExactBuckets get a bucket each. After
+// that, every doubling of the guess count is split into c_histogramSubBuckets buckets, so the histogram stays small
+// however big the lists get. Guess counts of 2^32 and up all land in the last bucket.
+static const size_t c_histogramExactBits = 4;
+static const size_t c_histogramSubBucketBits = 2;
+static const size_t c_histogramExactBuckets = size_t(1) << c_histogramExactBits;
+static const size_t c_histogramSubBuckets = size_t(1) << c_histogramSubBucketBits;
+static const size_t c_histogramNumBuckets = c_histogramExactBuckets + (32 - c_histogramExactBits) * c_histogramSubBuckets;
+
+struct GuessHistogram
 {
-    return (1.0f - t) * a + t * b;
-}
+    uint32_t counts[c_histogramNumBuckets];
 
-// ------------------------ MAKE LIST FUNCTIONS ------------------------
+    static size_t Bucket(size_t guesses)
+    {
+        if (guesses < c_histogramExactBuckets)
+            return guesses;
+
+        size_t log2 = 0;
+        while ((guesses >> log2) > 1)
+            log2++;
+
+        size_t subBucket = (guesses >> (log2 - c_histogramSubBucketBits)) & (c_histogramSubBuckets - 1);
+        size_t bucket = c_histogramExactBuckets + (log2 - c_histogramExactBits) * c_histogramSubBuckets + subBucket;
+        return std::min(bucket, c_histogramNumBuckets - 1);
+    }
+
+    // the smallest guess count that lands in a bucket. The biggest is one less than BucketMin(bucket + 1).
+    static size_t BucketMin(size_t bucket)
+    {
+        if (bucket < c_histogramExactBuckets)
+            return bucket;
+
+        size_t log2 = (bucket - c_histogramExactBuckets) / c_histogramSubBuckets + c_histogramExactBits;
+        size_t subBucket = (bucket - c_histogramExactBuckets) % c_histogramSubBuckets;
+        return (c_histogramSubBuckets + subBucket) << (log2 - c_histogramSubBucketBits);
+    }
+
+    void Clear()
+    {
+        memset(counts, 0, sizeof(counts));
+    }
+
+    void Add(size_t guesses)
+    {
+        counts[Bucket(guesses)]++;
+    }
+};
+
+// min, max and mean of a count
+struct CountStats
+{
+    size_t count;
+    size_t min;
+    size_t max;
+    double mean;
+
+    void Clear()
+    {
+        count = 0;
+        min = ~size_t(0);
+        max = 0;
+        mean = 0.0;
+    }
 
-void MakeList_Random(std::vector<size_t>& values, size_t count)
+    void Add(size_t value)
+    {
+        count++;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        mean += (double(value) - mean) / double(count);
+    }
+};
+
+// the levels of the cache simulator, in the order an access goes through them
+struct CacheSimLevelInfo
+{
+    const char* name;
+    const char* missesSuffix;
+};
+
+static const CacheSimLevelInfo c_cacheSimLevels[] =
+{
+    {"L1", " L1 Misses"},
+    {"L2", " L2 Misses"},
+    {"LLC", " LLC Misses"},
+    {"TLB", " TLB Misses"},
+};
+
+static const size_t c_cacheSimNumLevels = countof(c_cacheSimLevels);
+
+// Running statistics of the guess counts of a cell of the sweep. Mean and variance use Welford's online algorithm in
+// double precision, and percentiles come from the histogram.
+struct GuessStats
+{
+    size_t count;
+    size_t min;
+    size_t max;
+    double mean;
+    double m2;      // sum of squared differences from the mean
+    size_t single;  // the last sample, to show what one run looks like
+    GuessHistogram histogram;
+    CountStats cacheLines;  // distinct cache lines and pages read per search, when probe tracing is on
+    CountStats pages;
+    double cacheSimMisses[c_cacheSimNumLevels]; // misses per search of each simulated level, when the cache simulator is on
+
+    void Clear()
+    {
+        count = 0;
+        min = ~size_t(0);
+        max = 0;
+        mean = 0.0;
+        m2 = 0.0;
+        single = 0;
+        histogram.Clear();
+        cacheLines.Clear();
+        pages.Clear();
+        for (double& misses : cacheSimMisses)
+            misses = 0.0;
+    }
+
+    void Add(size_t guesses)
+    {
+        count++;
+        min = std::min(min, guesses);
+        max = std::max(max, guesses);
+        double delta = double(guesses) - mean;
+        mean += delta / double(count);
+        m2 += delta * (double(guesses) - mean);
+        single = guesses;
+        histogram.Add(guesses);
+    }
+
+    // sample variance
+    double Variance() const
+    {
+        return count > 1 ? m2 / double(count - 1) : 0.0;
+    }
+
+    double StdDev() const
+    {
+        return sqrt(Variance());
+    }
+
+    // The guess count that this fraction of the samples are at or under. Bucketed guess counts report the top of their
+    // bucket, so this never under reports.
+    size_t Percentile(double fraction) const
+    {
+        size_t rank = std::max<size_t>(size_t(ceil(fraction * double(count))), 1);
+        size_t seen = 0;
+        for (size_t bucket = 0; bucket < c_histogramNumBuckets; ++bucket)
+        {
+            seen += histogram.counts[bucket];
+            if (seen >= rank)
+                return Clamp(min, max, GuessHistogram::BucketMin(bucket + 1) - 1);
+        }
+        return max;
+    }
+};
+
+// How the search window (maxIndex - minIndex) shrinks, step by step, over the searches of a cell of the sweep. Step 0
+// is the window before the first guess. Sums are kept, and divided by the count of searches that got to that step.
+struct ConvergenceStats
+{
+    struct Step
+    {
+        size_t count;
+        double window;
+        double shrink;  // the window after the step over the window before it
+    };
+    std::vector<Step> steps;
+
+    void Clear()
+    {
+        steps.clear();
+    }
+
+    void Add(const std::vector<size_t>& windows)
+    {
+        if (steps.size() < windows.size())
+            steps.resize(windows.size(), Step{ 0, 0.0, 0.0 });
+        for (size_t index = 0; index < windows.size(); ++index)
+        {
+            steps[index].count++;
+            steps[index].window += double(windows[index]);
+            if (index == 0)
+                steps[index].shrink += 1.0;
+            else if (windows[index - 1] > 0)
+                steps[index].shrink += double(windows[index]) / double(windows[index - 1]);
+        }
+    }
+};
+
+struct GuessPercentile
+{
+    const char* nameSuffix;
+    double fraction;
+};
+
+static const GuessPercentile c_guessPercentiles[] =
 {
-    std::uniform_int_distribution<size_t> dist(0, c_maxValue);
+    {" P50", 0.50},
+    {" P90", 0.90},
+    {" P99", 0.99},
+};
 
-    static std::random_device rd("dev/random");
-    static std::seed_seq fullSeed{ rd(), rd(), rd(), rd(), rd(), rd(), rd(), rd() };
-    static std::mt19937 rng(fullSeed);
+// ------------------------ MAKE LIST FUNCTIONS ------------------------
+// All but the random list come out in increasing order by construction, so they don't need sorting.
 
+void MakeList_Random(std::vector<size_t>& values, size_t count, RNG& rng)
+{
     values.resize(count);
     for (size_t& v : values)
-        v = dist(rng);
+        v = rng.Range(0, c_maxValue);
 
     std::sort(values.begin(), values.end());
 }
 
-void MakeList_Linear(std::vector<size_t>& values, size_t count)
+void MakeList_Linear(std::vector<size_t>& values, size_t count, RNG&)
 {
     values.resize(count);
     for (size_t index = 0; index < count; ++index)
@@ -81,17 +428,15 @@ void MakeList_Linear(std::vector<size_t>& values, size_t count)
         y *= c_maxValue;
         values[index] = size_t(y);
     }
-
-    std::sort(values.begin(), values.end());
 }
 
-void MakeList_Linear_Outlier(std::vector<size_t>& values, size_t count)
+void MakeList_Linear_Outlier(std::vector<size_t>& values, size_t count, RNG& rng)
 {
-    MakeList_Linear(values, count);
+    MakeList_Linear(values, count, rng);
     *values.rbegin() = c_maxValue * 100;
 }
 
-void MakeList_Quadratic(std::vector<size_t>& values, size_t count)
+void MakeList_Quadratic(std::vector<size_t>& values, size_t count, RNG&)
 {
     values.resize(count);
     for (size_t index = 0; index < count; ++index)
@@ -101,11 +446,9 @@ void MakeList_Quadratic(std::vector<size_t>& values, size_t count)
         y *= c_maxValue;
         values[index] = size_t(y);
     }
-
-    std::sort(values.begin(), values.end());
 }
 
-void MakeList_Cubic(std::vector<size_t>& values, size_t count)
+void MakeList_Cubic(std::vector<size_t>& values, size_t count, RNG&)
 {
     values.resize(count);
     for (size_t index = 0; index < count; ++index)
@@ -115,11 +458,9 @@ void MakeList_Cubic(std::vector<size_t>& values, size_t count)
         y *= c_maxValue;
         values[index] = size_t(y);
     }
-
-    std::sort(values.begin(), values.end());
 }
 
-void MakeList_Log(std::vector<size_t>& values, size_t count)
+void MakeList_Log(std::vector<size_t>& values, size_t count, RNG&)
 {
     values.resize(count);
 
@@ -132,308 +473,685 @@ void MakeList_Log(std::vector<size_t>& values, size_t count)
         y *= c_maxValue;
         values[index] = size_t(y);
     }
-
-    std::sort(values.begin(), values.end());
 }
 
+REGISTER_MAKE_LIST("Random", MakeList_Random, false)
+REGISTER_MAKE_LIST("Linear", MakeList_Linear, true)
+REGISTER_MAKE_LIST("Linear Outlier", MakeList_Linear_Outlier, true)
+REGISTER_MAKE_LIST("Quadratic", MakeList_Quadratic, true)
+REGISTER_MAKE_LIST("Cubic", MakeList_Cubic, true)
+REGISTER_MAKE_LIST("Log", MakeList_Log, true)
+
 // ------------------------ TEST LIST FUNCTIONS ------------------------
+// The search functions are templated on a policy that does everything besides searching: counting the guesses and
+// recording the reads. The sweep uses the counting policy, or the tracing one, and the timed passes of the perf and
+// throughput tests use SearchPolicy_None, so what gets timed is only the search, with no counter updates.
 
-TestResults TestList_LinearSearch(const std::vector<size_t>& values, size_t searchValue)
+// The indices that a search read, in order. Recorded by SearchPolicy_Trace into the trace installed for the thread.
+struct ProbeTrace
 {
-    TestResults ret;
-    ret.found = false;
-    ret.guesses = 0;
-    ret.index = 0;
+    std::vector<size_t> indices;
+    std::vector<size_t> windows;    // maxIndex - minIndex before the first guess and after every guess that didn't end the search
+    std::vector<size_t> scratch;
 
-    while (1)
+    void Clear()
     {
-        if (ret.index >= values.size())
-            break;
-        ret.guesses++;
+        indices.clear();
+        windows.clear();
+    }
 
-        size_t value = values[ret.index];
-        if (value == searchValue)
-        {
-            ret.found = true;
-            break;
-        }
-        if (value > searchValue)
-            break;
+    // how many distinct blocks of blockSize bytes the reads touched, as if the list started on a block boundary
+    size_t DistinctBlocks(size_t blockSize)
+    {
+        scratch.clear();
+        for (size_t index : indices)
+            scratch.push_back(index * sizeof(size_t) / blockSize);
+        std::sort(scratch.begin(), scratch.end());
+        return size_t(std::unique(scratch.begin(), scratch.end()) - scratch.begin());
+    }
+};
 
-        ret.index++;
+thread_local ProbeTrace* t_probeTrace = nullptr;
+
+// counts guesses
+using SearchPolicy_Count = lfs::CountGuesses;
+
+// counts guesses and records the reads and the search windows
+struct SearchPolicy_Trace : SearchPolicy_Count
+{
+    template <typename T>
+    static T Read(lfs::Span<T> values, size_t index)
+    {
+        if (t_probeTrace)
+            t_probeTrace->indices.push_back(index);
+        return values[index];
     }
 
-    return ret;
+    static void Window(size_t window)
+    {
+        if (t_probeTrace)
+            t_probeTrace->windows.push_back(window);
+    }
+};
+
+// only searches. The guess count of the results stays 0.
+using SearchPolicy_None = lfs::NoInstrumentation;
+
+// The search functions themselves are in linear_fit_search.hpp. These adapt them to the benchmark's lists.
+
+template <typename TPolicy>
+TestResults TestList_LinearSearch(const std::vector<size_t>& values, size_t searchValue)
+{
+    return lfs::LinearSearch<TPolicy>(lfs::Span(values), searchValue);
 }
 
+template <typename TPolicy>
 TestResults TestList_LineFit(const std::vector<size_t>& values, size_t searchValue)
 {
-    // The idea of this test is that we keep a fit of a line y=mx+b
-    // of the left and right side known data points, and use that
-    // info to make a guess as to where the value will be.
-    //
-    // When a guess is wrong, it becomes the new left or right of the line
-    // depending on if it was too low (left) or too high (right).
-    //
-    // This function returns how many steps it took to find the value
-    // but doesn't include the min and max reads at the beginning because
-    // those could reasonably be done in advance.
-
-    // get the starting min and max value.
-    size_t minIndex = 0;
-    size_t maxIndex = values.size() - 1;
-    size_t min = values[minIndex];
-    size_t max = values[maxIndex];
+    return lfs::LineFitSearch<TPolicy>(lfs::Span(values), searchValue);
+}
 
-    TestResults ret;
-    ret.found = true;
-    ret.guesses = 0;
+using lfs::HybridParams;
 
-    // if we've already found the value, we are done
-    if (searchValue < min)
-    {
-        ret.index = minIndex;
-        ret.found = false;
-        return ret;
-    }
-    if (searchValue > max)
+static const HybridParams c_hybridDefaultParams;
+
+// the tuned parameters of a number sequence, found by --mode=tune
+struct HybridTuning
+{
+    std::string dataset;
+    HybridParams params;
+};
+
+// The registered hybrid search uses the default parameters. Tuned parameters are carried by an lfs::HybridIndex, which
+// the tuner and the perf test time against the defaults.
+template <typename TPolicy>
+TestResults TestList_HybridSearch(const std::vector<size_t>& values, size_t searchValue)
+{
+    return lfs::HybridSearch<TPolicy>(lfs::Span(values), searchValue);
+}
+
+template <typename TPolicy>
+TestResults TestList_BinarySearch(const std::vector<size_t>& values, size_t searchValue)
+{
+    return lfs::BinarySearch<TPolicy>(lfs::Span(values), searchValue);
+}
+
+template <typename TPolicy>
+TestResults TestList_LineFitBlind(const std::vector<size_t>& values, size_t searchValue)
+{
+    // If you want to know how this does against binary search without first knowing the min and max, this result is for you.
+    // It takes 2 extra samples to get the min and max, so we are counting those as guesses (memory reads).
+    TestResults ret = TestList_LineFit<TPolicy>(values, searchValue);
+    TPolicy::Guess(ret, 2);
+    return ret;
+}
+
+REGISTER_TEST_LIST("Linear Search", TestList_LinearSearch)
+REGISTER_TEST_LIST("Line Fit", TestList_LineFit)
+REGISTER_TEST_LIST("Line Fit Blind", TestList_LineFitBlind)
+REGISTER_TEST_LIST("Binary Search", TestList_BinarySearch)
+REGISTER_TEST_LIST("Hybrid", TestList_HybridSearch)
+
+// The index classes of the library, built once per list with the engine build step. Their searches find the index in
+// t_searchIndex.
+template <typename TIndex>
+struct LibrarySearchIndex : public SearchIndex
+{
+    TIndex index;
+
+    explicit LibrarySearchIndex(const std::vector<size_t>& values) : index(lfs::Span<size_t>(values)) {}
+
+    size_t Bytes() const override
     {
-        ret.index = maxIndex;
-        ret.found = false;
-        return ret;
+        return sizeof(TIndex);
     }
-    if (searchValue == min)
-    {
-        ret.index = minIndex;
+};
+
+template <typename TIndex>
+std::unique_ptr<SearchIndex> BuildLibraryIndex(const std::vector<size_t>& values)
+{
+    return std::make_unique<LibrarySearchIndex<TIndex>>(values);
+}
+
+template <typename TPolicy>
+TestResults TestList_LineFitIndex(const std::vector<size_t>&, size_t searchValue)
+{
+    return static_cast<const LibrarySearchIndex<lfs::LineFitIndex<size_t>>*>(t_searchIndex)->index.Search<TPolicy>(searchValue);
+}
+
+template <typename TPolicy>
+TestResults TestList_BoundedLineFitIndex(const std::vector<size_t>&, size_t searchValue)
+{
+    return static_cast<const LibrarySearchIndex<lfs::BoundedLineFitIndex<size_t>>*>(t_searchIndex)->index.Search<TPolicy>(searchValue);
+}
+
+REGISTER_INDEXED_TEST_LIST("Line Fit Index", TestList_LineFitIndex, BuildLibraryIndex<lfs::LineFitIndex<size_t>>)
+REGISTER_INDEXED_TEST_LIST("Bounded Line Fit Index", TestList_BoundedLineFitIndex, BuildLibraryIndex<lfs::BoundedLineFitIndex<size_t>>)
+
+// The fixed size searches only work on lists of exactly N values, so they aren't registered. --mode=fixed times them
+// against the same searches for any size.
+template <size_t N, typename TPolicy>
+TestResults TestList_FixedBinarySearch(const std::vector<size_t>& values, size_t searchValue)
+{
+    return lfs::FixedBinarySearch<N, TPolicy>(values.data(), searchValue);
+}
+
+static const size_t c_fixedLineFitSteps = 2;    // line fit steps of the fixed size line fit search, before the binary finish
+
+template <size_t N, typename TPolicy>
+TestResults TestList_FixedLineFit(const std::vector<size_t>& values, size_t searchValue)
+{
+    return lfs::FixedLineFitSearch<N, c_fixedLineFitSteps, TPolicy>(values.data(), searchValue);
+}
+
+// lfs::FixedLineFitSearch for a size only known at run time: the same line fit steps, then the same branchless binary
+// search of the window they leave, but with loops that run until they're done. --mode=fixed times the fixed size
+// search against this, so what it measures is what knowing the size saves, not a different algorithm.
+template <typename TPolicy>
+TestResults TestList_LineFitThenBinary(const std::vector<size_t>& values, size_t searchValue)
+{
+    lfs::Span<size_t> span(values);
+    TestResults ret = { false, 0, 0 };
+    if (span.empty())
         return ret;
-    }
-    if (searchValue == max)
+
+    size_t minIndex = 0;
+    size_t maxIndex = span.size() - 1;
+    size_t min = TPolicy::Read(span, minIndex);
+    size_t max = TPolicy::Read(span, maxIndex);
+    if (searchValue <= min || searchValue >= max)
     {
-        ret.index = maxIndex;
+        ret.index = searchValue <= min ? minIndex : maxIndex;
+        ret.found = searchValue == min || searchValue == max;
         return ret;
     }
 
-    // fit a line to the end points
-    // y = mx + b
-    // m = rise / run
-    // b = y - mx
-    float m = (float(max) - float(min)) / float(maxIndex - minIndex);
-    float b = float(min) - m * float(minIndex);
-
-    while (1)
+    for (size_t step = 0; step < c_fixedLineFitSteps && minIndex + 1 < maxIndex; ++step)
     {
-        // make a guess based on our line fit
-        ret.guesses++;
-        size_t guessIndex = size_t(0.5f + (float(searchValue) - b) / m);
-        guessIndex = Clamp(minIndex + 1, maxIndex - 1, guessIndex);
-        size_t guess = values[guessIndex];
-
-        // if we found it, return success
+        TPolicy::Guess(ret);
+        float m = (float(max) - float(min)) / float(maxIndex - minIndex);
+        size_t guessIndex = minIndex + size_t(0.5f + (float(searchValue) - float(min)) / m);
+        guessIndex = std::min(std::max(guessIndex, minIndex + 1), maxIndex - 1);
+        size_t guess = TPolicy::Read(span, guessIndex);
         if (guess == searchValue)
         {
             ret.index = guessIndex;
+            ret.found = true;
             return ret;
         }
-
-        // if we were too low, this is our new minimum
         if (guess < searchValue)
         {
             minIndex = guessIndex;
             min = guess;
         }
-        // else we were too high, this is our new maximum
         else
         {
             maxIndex = guessIndex;
             max = guess;
         }
+    }
 
-        // if we run out of places to look, we didn't find it
-        if (minIndex + 1 >= maxIndex)
-        {
-            ret.index = minIndex;
-            ret.found = false;
-            return ret;
-        }
+    size_t base = minIndex;
+    size_t count = maxIndex - minIndex;
+    while (count > 1)
+    {
+        size_t half = count / 2;
+        TPolicy::Guess(ret);
+        base = TPolicy::Read(span, base + half) <= searchValue ? base + half : base;
+        count -= half;
+    }
+    ret.index = base;
+    ret.found = TPolicy::Read(span, base) == searchValue;
+    return ret;
+}
 
-        // fit a new line
-        m = (float(max) - float(min)) / float(maxIndex - minIndex);
-        b = float(min) - m * float(minIndex);
+// ------------------------ COMPILE TIME TABLES ------------------------
+// The linear, quadratic and cubic number sequences as tables the compiler makes, searched and indexed by the compiler.
+// If a search stops working in constant expressions, or gets a table value wrong, this doesn't compile.
+
+template <size_t N, int Power>
+constexpr std::array<size_t, N> MakeTable_Power()
+{
+    std::array<size_t, N> values = {};
+    for (size_t index = 0; index < N; ++index)
+    {
+        float x = float(index) / (N > 1 ? float(N - 1) : 1);
+        float y = 1.0f;
+        for (int power = 0; power < Power; ++power)
+            y *= x;
+        y *= c_maxValue;
+        values[index] = size_t(y);
     }
+    return values;
+}
 
-    return ret;
+// every value has to be found, and the values just past them have to be found only if they are in the table
+template <size_t N>
+constexpr bool CheckTable(const std::array<size_t, N>& values)
+{
+    lfs::Span<size_t> span(values);
+    const lfs::BoundedLineFitIndex<size_t> index(span);
+    for (size_t valueIndex = 0; valueIndex < N; ++valueIndex)
+    {
+        for (size_t key = values[valueIndex]; key <= values[valueIndex] + 1; ++key)
+        {
+            bool inTable = false;
+            for (size_t value : values)
+                inTable = inTable || value == key;
+            TestResults results[] =
+            {
+                lfs::LinearSearch(span, key),
+                lfs::LineFitSearch(span, key),
+                lfs::HybridSearch(span, key),
+                lfs::BinarySearch(span, key),
+                lfs::FixedBinarySearch<N>(values.data(), key),
+                lfs::FixedLineFitSearch<N>(values.data(), key),
+                index.Search(key),
+            };
+            for (const TestResults& result : results)
+            {
+                if (result.found != inTable || (result.found && values[result.index] != key))
+                    return false;
+            }
+        }
+    }
+    return true;
 }
 
-TestResults TestList_HybridSearch(const std::vector<size_t>& values, size_t searchValue)
+static constexpr std::array<size_t, 64> c_tableLinear = MakeTable_Power<64, 1>();
+static constexpr std::array<size_t, 64> c_tableQuadratic = MakeTable_Power<64, 2>();
+static constexpr std::array<size_t, 64> c_tableCubic = MakeTable_Power<64, 3>();
+
+static_assert(CheckTable(c_tableLinear), "A search gets the compile time linear table wrong");
+static_assert(CheckTable(c_tableQuadratic), "A search gets the compile time quadratic table wrong");
+static_assert(CheckTable(c_tableCubic), "A search gets the compile time cubic table wrong");
+
+// the line and error bound are worked out by the compiler too
+static constexpr lfs::BoundedLineFitIndex<size_t> c_tableCubicIndex{ lfs::Span(c_tableCubic) };
+static_assert(c_tableCubicIndex.Search(c_tableCubic[40]).index == 40, "The compile time index of the cubic table is wrong");
+
+// repeated values fit a line of more than one index per unit, which predicts past a size_t for keys far past the end
+static constexpr size_t c_tableRepeats[] = { 5, 5, 5, 6 };
+static constexpr lfs::BoundedLineFitIndex<size_t> c_tableRepeatsIndex{ lfs::Span(c_tableRepeats) };
+static_assert(c_tableRepeatsIndex.Predict(SIZE_MAX) == 3 && c_tableRepeatsIndex.Search(SIZE_MAX).index == 3 && !c_tableRepeatsIndex.Search(SIZE_MAX).found,
+    "The compile time index of a table with repeats is wrong past the end");
+
+// ------------------------ CSV WRITER ------------------------
+
+// Writes a csv a row at a time. Cells are formatted straight into a row buffer that gets reused, so writing a sheet
+// doesn't hold a string per cell. Every cell is quoted and followed by a comma, to match the csvs in out/.
+struct CSVWriter
 {
-    // On even iterations, this does a line fit step.
-    // On odd iterations, this does a binary search step.
-    // Line fit can do better than binary search, but it can also get trapped in situations that it does poorly.
-    // The binary search step is there to help it break out of those situations.
+    FILE* file = nullptr;
+    std::vector<char> row;
 
-    // get the starting min and max value.
-    size_t minIndex = 0;
-    size_t maxIndex = values.size() - 1;
-    size_t min = values[minIndex];
-    size_t max = values[maxIndex];
+    bool Open(const char* fileName)
+    {
+        fopen_s(&file, fileName, "w+b");
+        row.reserve(4096);
+        return file != nullptr;
+    }
 
-    TestResults ret;
-    ret.found = true;
-    ret.guesses = 0;
+    void Close()
+    {
+        if (file)
+            fclose(file);
+        file = nullptr;
+    }
 
-    // if we've already found the value, we are done
-    if (searchValue < min)
+    void Cell(const char* text)
     {
-        ret.index = minIndex;
-        ret.found = false;
-        return ret;
+        row.push_back('"');
+        row.insert(row.end(), text, text + strlen(text));
+        row.push_back('"');
+        row.push_back(',');
     }
-    if (searchValue > max)
+
+    void Cell(const char* prefix, const char* suffix)
     {
-        ret.index = maxIndex;
-        ret.found = false;
-        return ret;
+        row.push_back('"');
+        row.insert(row.end(), prefix, prefix + strlen(prefix));
+        row.insert(row.end(), suffix, suffix + strlen(suffix));
+        row.push_back('"');
+        row.push_back(',');
     }
-    if (searchValue == min)
+
+    void Cell(size_t value)
     {
-        ret.index = minIndex;
-        return ret;
+        char buffer[32];
+        char* end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        row.push_back('"');
+        row.insert(row.end(), buffer, end);
+        row.push_back('"');
+        row.push_back(',');
     }
-    if (searchValue == max)
+
+    // same output as printf's %f
+    void Cell(float value)
     {
-        ret.index = maxIndex;
-        return ret;
+        Cell(double(value));
     }
 
-    // fit a line to the end points
-    // y = mx + b
-    // m = rise / run
-    // b = y - mx
-    float m = (float(max) - float(min)) / float(maxIndex - minIndex);
-    float b = float(min) - m * float(minIndex);
+    void Cell(double value)
+    {
+        char buffer[512];
+        int length = sprintf_s(buffer, "%f", value);
+        row.push_back('"');
+        row.insert(row.end(), buffer, buffer + length);
+        row.push_back('"');
+        row.push_back(',');
+    }
 
-    bool doBinaryStep = false;
-    while (1)
+    void EndRow()
     {
-        // make a guess based on our line fit, or by binary search, depending on the value of doBinaryStep
-        ret.guesses++;
-        size_t guessIndex = doBinaryStep ? (minIndex + maxIndex) / 2 : size_t(0.5f + (float(searchValue) - b) / m);
-        guessIndex = Clamp(minIndex + 1, maxIndex - 1, guessIndex);
-        size_t guess = values[guessIndex];
+        row.push_back('\n');
+        fwrite(row.data(), 1, row.size(), file);
+        row.clear();
+    }
+};
 
-        // if we found it, return success
-        if (guess == searchValue)
-        {
-            ret.index = guessIndex;
-            return ret;
-        }
+// ------------------------ BINARY RESULTS ------------------------
 
-        // if we were too low, this is our new minimum
-        if (guess < searchValue)
-        {
-            minIndex = guessIndex;
-            min = guess;
-        }
-        // else we were too high, this is our new maximum
-        else
-        {
-            maxIndex = guessIndex;
-            max = guess;
-        }
+// A columnar alternative to the csvs, for sweeps too big to write and load as quoted text. Everything is little endian.
+//
+//   char[4]  "LFSR"
+//   uint32   version
+//   uint64   seed the results were made with
+//   uint64   number of rows
+//   uint32   number of columns
+//   uint32   c_histogramExactBits, c_histogramSubBucketBits - the histogram bucket layout (see GuessHistogram)
+//   per column: uint8 type (BinaryColumnType), uint32 name length, name (not null terminated),
+//               and for Histogram columns a uint32 number of buckets stored per row
+//   per column, in the same order: every row of that column
+//
+// A row of a U64 column is a uint64, of an F32 column a float, of an F64 column a double, and of a Histogram column that column's number of
+// buckets of uint32 counts. Histograms are cut off after the last bucket any row of the column uses.
 
-        // if we run out of places to look, we didn't find it
-        if (minIndex + 1 >= maxIndex)
-        {
-            ret.index = minIndex;
-            ret.found = false;
-            return ret;
-        }
+static const char c_binaryResultsMagic[4] = { 'L', 'F', 'S', 'R' };
+static const uint32_t c_binaryResultsVersion = 1;
 
-        // fit a new line
-        m = (float(max) - float(min)) / float(maxIndex - minIndex);
-        b = float(min) - m * float(minIndex);
+enum class BinaryColumnType : uint8_t
+{
+    U64 = 1,
+    F32 = 2,
+    Histogram = 3,
+    F64 = 4,
+};
 
-        // toggle what search mode we are using
-        doBinaryStep = !doBinaryStep;
-    }
+struct BinaryColumn
+{
+    const char* name;
+    const char* nameSuffix;
+    BinaryColumnType type;
+    size_t numBuckets;
+};
 
-    return ret;
+size_t BinaryColumnRowSize(BinaryColumnType type, size_t numBuckets)
+{
+    switch (type)
+    {
+        case BinaryColumnType::U64: return sizeof(uint64_t);
+        case BinaryColumnType::F32: return sizeof(float);
+        case BinaryColumnType::F64: return sizeof(double);
+        case BinaryColumnType::Histogram: return sizeof(uint32_t) * numBuckets;
+    }
+    return 0;
 }
 
-TestResults TestList_BinarySearch(const std::vector<size_t>& values, size_t searchValue)
+// Builds a results file in memory and writes it out in one go
+struct BinaryResultsWriter
 {
-    TestResults ret;
-    ret.found = false;
-    ret.guesses = 0;
+    std::vector<uint8_t> bytes;
 
-    size_t minIndex = 0;
-    size_t maxIndex = values.size()-1;
-    while (1)
+    void PutU8(uint8_t value)
     {
-        // make a guess by looking in the middle of the unknown area
-        ret.guesses++;
-        size_t guessIndex = (minIndex + maxIndex) / 2;
-        size_t guess = values[guessIndex];
+        bytes.push_back(value);
+    }
 
-        // found it
-        if (guess == searchValue)
+    void PutU32(uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            bytes.push_back(uint8_t(value >> (i * 8)));
+    }
+
+    void PutU64(uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i)
+            bytes.push_back(uint8_t(value >> (i * 8)));
+    }
+
+    void PutF32(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        PutU32(bits);
+    }
+
+    void PutF64(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        PutU64(bits);
+    }
+
+    void PutHistogram(const GuessHistogram& histogram, size_t numBuckets)
+    {
+        for (size_t bucket = 0; bucket < numBuckets; ++bucket)
+            PutU32(histogram.counts[bucket]);
+    }
+
+    void PutHeader(uint64_t seed, uint64_t numRows, const std::vector<BinaryColumn>& columns)
+    {
+        bytes.insert(bytes.end(), c_binaryResultsMagic, c_binaryResultsMagic + 4);
+        PutU32(c_binaryResultsVersion);
+        PutU64(seed);
+        PutU64(numRows);
+        PutU32(uint32_t(columns.size()));
+        PutU32(uint32_t(c_histogramExactBits));
+        PutU32(uint32_t(c_histogramSubBucketBits));
+        for (const BinaryColumn& column : columns)
         {
-            ret.found = true;
-            ret.index = guessIndex;
-            return ret;
+            PutU8(uint8_t(column.type));
+            size_t nameLength = strlen(column.name);
+            size_t suffixLength = strlen(column.nameSuffix);
+            PutU32(uint32_t(nameLength + suffixLength));
+            bytes.insert(bytes.end(), column.name, column.name + nameLength);
+            bytes.insert(bytes.end(), column.nameSuffix, column.nameSuffix + suffixLength);
+            if (column.type == BinaryColumnType::Histogram)
+                PutU32(uint32_t(column.numBuckets));
+        }
+    }
+
+    bool Save(const char* fileName) const
+    {
+        FILE* file = nullptr;
+        fopen_s(&file, fileName, "w+b");
+        if (!file)
+            return false;
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+        return true;
+    }
+};
+
+// A results file read back in, from either format. Number columns have a value per row. Histogram columns only come
+// from binary files, and csv columns also keep the text of their cells.
+struct ResultsTable
+{
+    struct Column
+    {
+        std::string name;
+        BinaryColumnType type;
+        std::vector<double> values;
+        std::vector<std::string> text;
+        size_t numBuckets = 0;
+        std::vector<uint32_t> histograms;   // numBuckets counts per row
+    };
+
+    size_t numRows = 0;
+    std::vector<Column> columns;
+
+    const Column* Find(const std::string& name) const
+    {
+        for (const Column& column : columns)
+        {
+            if (column.name == name)
+                return &column;
         }
-        // if our guess was too low, it's the new min
-        else if (guess < searchValue)
+        return nullptr;
+    }
+};
+
+// Returns false if the file couldn't be read
+bool LoadResultsBinary(const char* fileName, ResultsTable& table)
+{
+    FILE* file = nullptr;
+    fopen_s(&file, fileName, "rb");
+    if (!file)
+        return false;
+    std::vector<uint8_t> bytes;
+    {
+        uint8_t buffer[65536];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            bytes.insert(bytes.end(), buffer, buffer + count);
+    }
+    fclose(file);
+
+    size_t offset = 0;
+    bool ok = true;
+    auto Get = [&](size_t size) -> uint64_t
+    {
+        uint64_t value = 0;
+        if (offset + size > bytes.size())
         {
-            minIndex = guessIndex + 1;
+            ok = false;
+            return 0;
         }
-        // if our guess was too high, it's the new max
-        else if (guess > searchValue)
+        for (size_t i = 0; i < size; ++i)
+            value |= uint64_t(bytes[offset + i]) << (i * 8);
+        offset += size;
+        return value;
+    };
+
+    if (bytes.size() < 4 || memcmp(bytes.data(), c_binaryResultsMagic, 4) != 0)
+        return false;
+    offset = 4;
+    if (Get(4) != c_binaryResultsVersion)
+        return false;
+    Get(8); // seed
+    size_t numRows = size_t(Get(8));
+    size_t numColumns = size_t(Get(4));
+    Get(4); // histogram exact bits
+    Get(4); // histogram sub bucket bits
+    if (!ok)
+        return false;
+
+    table.numRows = numRows;
+    table.columns.clear();
+    table.columns.resize(numColumns);
+    for (ResultsTable::Column& column : table.columns)
+    {
+        column.type = BinaryColumnType(Get(1));
+        size_t nameLength = size_t(Get(4));
+        if (!ok || offset + nameLength > bytes.size())
+            return false;
+        column.name.assign((const char*)&bytes[offset], nameLength);
+        offset += nameLength;
+        column.numBuckets = column.type == BinaryColumnType::Histogram ? size_t(Get(4)) : 0;
+    }
+    for (ResultsTable::Column& column : table.columns)
+    {
+        size_t rowSize = BinaryColumnRowSize(column.type, column.numBuckets);
+        if (!ok || (rowSize == 0 && column.type != BinaryColumnType::Histogram))
+            return false;
+        if (offset + rowSize * numRows > bytes.size())
+            return false;
+
+        for (size_t rowIndex = 0; rowIndex < numRows; ++rowIndex)
         {
-            // underflow prevention
-            if (guessIndex == 0)
+            if (column.type == BinaryColumnType::U64)
+            {
+                column.values.push_back(double(Get(8)));
+            }
+            else if (column.type == BinaryColumnType::F32)
+            {
+                uint32_t bits = uint32_t(Get(4));
+                float value;
+                memcpy(&value, &bits, sizeof(value));
+                column.values.push_back(value);
+            }
+            else if (column.type == BinaryColumnType::F64)
+            {
+                uint64_t bits = Get(8);
+                double value;
+                memcpy(&value, &bits, sizeof(value));
+                column.values.push_back(value);
+            }
+            else
             {
-                ret.index = guessIndex;
-                return ret;
+                for (size_t bucket = 0; bucket < column.numBuckets; ++bucket)
+                    column.histograms.push_back(uint32_t(Get(4)));
             }
-            maxIndex = guessIndex - 1;
         }
+    }
+    return ok;
+}
+
+// Reads a results file back in and writes it out as the csv the sweep would have written. Histogram columns have no
+// csv equivalent, so they are left out. Returns false if the file couldn't be read.
+bool ConvertBinaryResultsToCSV(const char* binaryFileName, const char* csvFileName)
+{
+    ResultsTable table;
+    if (!LoadResultsBinary(binaryFileName, table))
+        return false;
+
+    CSVWriter csv;
+    if (!csv.Open(csvFileName))
+        return false;
 
-        // fail case
-        if (minIndex > maxIndex)
+    for (const ResultsTable::Column& column : table.columns)
+    {
+        if (column.type != BinaryColumnType::Histogram)
+            csv.Cell(column.name.c_str());
+    }
+    csv.EndRow();
+
+    for (size_t rowIndex = 0; rowIndex < table.numRows; ++rowIndex)
+    {
+        for (const ResultsTable::Column& column : table.columns)
         {
-            ret.index = guessIndex;
-            return ret;
+            if (column.type == BinaryColumnType::U64)
+                csv.Cell(size_t(column.values[rowIndex]));
+            else if (column.type == BinaryColumnType::F32)
+                csv.Cell(float(column.values[rowIndex]));
+            else if (column.type == BinaryColumnType::F64)
+                csv.Cell(column.values[rowIndex]);
         }
+        csv.EndRow();
     }
 
-    return ret;
-}
-
-TestResults TestList_LineFitBlind(const std::vector<size_t>& values, size_t searchValue)
-{
-    // If you want to know how this does against binary search without first knowing the min and max, this result is for you.
-    // It takes 2 extra samples to get the min and max, so we are counting those as guesses (memory reads).
-    TestResults ret = TestList_LineFit(values, searchValue);
-    ret.guesses += 2;
-    return ret;
+    csv.Close();
+    return true;
 }
 
-// ------------------------ MAIN ------------------------
+// ------------------------ VERIFICATION ------------------------
 
-void VerifyResults(const std::vector<size_t>& values, size_t searchValue, const TestResults& result, const char* list, const char* test)
+// Verifies a search result against a binary search, which is O(log n), so verification can stay on for big lists.
+// Prints a message and returns false if the result was wrong.
+bool VerifyResults(const std::vector<size_t>& values, size_t searchValue, const TestResults& result, const char* list, const char* test)
 {
-    #if VERIFY_RESULT()
-    // verify correctness of result by comparing to a linear search
-    TestResults actualResult = TestList_LinearSearch(values, searchValue);
-    if (result.found != actualResult.found)
+    bool actuallyFound = std::binary_search(values.begin(), values.end(), searchValue);
+    if (result.found != actuallyFound)
     {
-        printf("VERIFICATION FAILURE!! (found %s vs %s) %s, %s\n", result.found ? "true" : "false", actualResult.found ? "true" : "false", list, test);
+        printf("VERIFICATION FAILURE!! (found %s vs %s) %s, %s\n", result.found ? "true" : "false", actuallyFound ? "true" : "false", list, test);
+        return false;
     }
-    else if (result.found == true && result.index != actualResult.index && values[result.index] != values[actualResult.index])
+    // Note that in the case of duplicates, different algorithms may return different indices, but the values stored in them should be the same
+    else if (result.found == true && (result.index >= values.size() || values[result.index] != searchValue))
     {
-        // Note that in the case of duplicates, different algorithms may return different indices, but the values stored in them should be the same
-        printf("VERIFICATION FAILURE!! (index %zu vs %zu) %s, %s\n", result.index, actualResult.index, list, test);
+        printf("VERIFICATION FAILURE!! (index %zu holds the wrong value) %s, %s\n", result.index, list, test);
+        return false;
     }
     // verify that the index returned is a reasonable place for the value to be inserted, if the value was not found.
     else if (result.found == false)
@@ -448,211 +1166,3473 @@ void VerifyResults(const std::vector<size_t>& values, size_t searchValue, const
             lte = searchValue <= values[result.index + 1];
 
         if (gte == false || lte == false)
+        {
             printf("VERIFICATION FAILURE!! Not a valid place to insert a new value! %s, %s\n", list, test);
+            return false;
+        }
     }
 
-    #endif
+    return true;
 }
 
-int main(int argc, char** argv)
+// Decides which searches get verified. A rate of 1 verifies everything and 0 verifies nothing. The choice is a hash of
+// a key, such as the index of the search, so the same searches get picked no matter which search function is running.
+struct VerifySampler
 {
-    MakeListInfo MakeFns[] =
-    {
-        {"Random", MakeList_Random},
-        {"Linear", MakeList_Linear},
-        {"Linear Outlier", MakeList_Linear_Outlier},
-        {"Quadratic", MakeList_Quadratic},
-        {"Cubic", MakeList_Cubic},
-        {"Log", MakeList_Log},
-    };
+    uint64_t threshold = ~uint64_t(0);
+    bool all = true;
 
-    TestListInfo TestFns[] =
+    void SetRate(double rate)
     {
-        {"Linear Search", TestList_LinearSearch},
-        {"Line Fit", TestList_LineFit},
-        {"Line Fit Blind", TestList_LineFitBlind},
-        {"Binary Search", TestList_BinarySearch},
-        {"Hybrid", TestList_HybridSearch},
-    };
-
-#if MAKE_CSVS()
-
-    size_t numThreads = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads;
-    threads.resize(numThreads);
+        all = rate >= 1.0;
+        threshold = rate <= 0.0 ? 0 : uint64_t(rate * 18446744073709551615.0);
+    }
 
-    typedef std::vector<std::string> TRow;
-    typedef std::vector<TRow> TSheet;
+    bool Enabled() const
+    {
+        return all || threshold > 0;
+    }
 
-    // for each numer sequence. Done multithreadedly
-    std::atomic<size_t> nextRow(0);
-    for (std::thread& t : threads)
+    bool Sample(uint64_t key) const
     {
-        t = std::thread(
-            [&]()
-            {
-                size_t makeIndex = nextRow.fetch_add(1);
-                while (makeIndex < countof(MakeFns))
-                {
-                    printf("Starting %s\n", MakeFns[makeIndex].name);
+        return all || DeriveSeed(0x5EED5A3B1E5ull, key) < threshold;
+    }
+};
 
-                    static std::random_device rd("dev/random");
-                    static std::seed_seq fullSeed{ rd(), rd(), rd(), rd(), rd(), rd(), rd(), rd() };
-                    static std::mt19937 rng(fullSeed);
+// Verifies batches of search results on its own thread, so verification stays out of the timed loops. The lists a
+// batch points at have to stay alive and unchanged until Finish() returns.
+class AsyncVerifier
+{
+public:
+    struct Query
+    {
+        size_t searchValue;
+        TestResults result;
+    };
 
-                    // the data to write to the csv file. a row per sample count plus one more for titles
-                    TSheet csv;
-                    csv.resize(c_maxNumValues + 1);
+    struct Batch
+    {
+        const std::vector<size_t>* values;
+        const char* list;
+        const char* test;
+        std::vector<Query> queries;
+    };
 
-                    // make a column for the sample counts
-                    char buffer[256];
-                    csv[0].push_back("Sample Count");
-                    for (size_t numValues = 1; numValues <= c_maxNumValues; ++numValues)
-                    {
-                        sprintf_s(buffer, "%zu", numValues);
-                        csv[numValues].push_back(buffer);
-                    }
+    AsyncVerifier()
+    {
+        m_thread = std::thread([this]() { Run(); });
+    }
 
-                    // for each test
-                    std::vector<size_t> values;
-                    for (size_t testIndex = 0; testIndex < countof(TestFns); ++testIndex)
-                    {
-                        sprintf_s(buffer, "%s Min", TestFns[testIndex].name);
-                        csv[0].push_back(buffer);
-                        sprintf_s(buffer, "%s Max", TestFns[testIndex].name);
-                        csv[0].push_back(buffer);
-                        sprintf_s(buffer, "%s Avg", TestFns[testIndex].name);
-                        csv[0].push_back(buffer);
-                        sprintf_s(buffer, "%s Single", TestFns[testIndex].name);
-                        csv[0].push_back(buffer);
-
-                        // for each result
-                        for (size_t numValues = 1; numValues <= c_maxNumValues; ++numValues)
-                        {
-                            size_t guessMin = ~size_t(0);
-                            size_t guessMax = 0;
-                            float guessAverage = 0.0f;
-                            size_t guessSingle = 0;
+    ~AsyncVerifier()
+    {
+        Finish();
+    }
 
-                            // repeat it a number of times to gather min, max, average
-                            for (size_t repeatIndex = 0; repeatIndex < c_numRunsPerTest; ++repeatIndex)
-                            {
-                                std::uniform_int_distribution<size_t> dist(0, c_maxValue);
-                                size_t searchValue = dist(rng);
+    void Submit(Batch&& batch)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_batches.push_back(std::move(batch));
+            m_pending++;
+        }
+        m_wake.notify_one();
+    }
 
-                                MakeFns[makeIndex].fn(values, numValues);
-                                TestResults result = TestFns[testIndex].fn(values, searchValue);
+    // waits for everything submitted so far to be verified, so the lists they point at can be changed or freed
+    void Wait()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_idle.wait(lock, [this]() { return m_pending == 0; });
+    }
 
-                                VerifyResults(values, searchValue, result, MakeFns[makeIndex].name, TestFns[testIndex].name);
+    // waits for everything submitted so far to be verified. Returns how many results failed verification.
+    size_t Finish()
+    {
+        if (m_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_done = true;
+            }
+            m_wake.notify_one();
+            m_thread.join();
+        }
+        return m_failures;
+    }
 
-                                guessMin = std::min(guessMin, result.guesses);
-                                guessMax = std::max(guessMax, result.guesses);
-                                guessAverage = Lerp(guessAverage, float(result.guesses), 1.0f / float(repeatIndex + 1));
-                                guessSingle = result.guesses;
-                            }
+private:
+    void Run()
+    {
+        while (1)
+        {
+            Batch batch;
+            {
+                std::unique_lock<std::mutex> lock(m_lock);
+                m_wake.wait(lock, [this]() { return m_done || !m_batches.empty(); });
+                if (m_batches.empty())
+                    return;
+                batch = std::move(m_batches.front());
+                m_batches.pop_front();
+            }
 
-                            sprintf_s(buffer, "%zu", guessMin);
-                            csv[numValues].push_back(buffer);
+            for (const Query& query : batch.queries)
+            {
+                if (!VerifyResults(*batch.values, query.searchValue, query.result, batch.list, batch.test))
+                    m_failures++;
+            }
 
-                            sprintf_s(buffer, "%zu", guessMax);
-                            csv[numValues].push_back(buffer);
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_pending--;
+            }
+            m_idle.notify_all();
+        }
+    }
 
-                            sprintf_s(buffer, "%f", guessAverage);
-                            csv[numValues].push_back(buffer);
+    std::thread m_thread;
+    std::mutex m_lock;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    std::deque<Batch> m_batches;
+    size_t m_pending = 0;
+    bool m_done = false;
+    size_t m_failures = 0;
+};
 
-                            sprintf_s(buffer, "%zu", guessSingle);
-                            csv[numValues].push_back(buffer);
-                        }
-                    }
+// ------------------------ CACHE SIMULATOR ------------------------
+// Replays the reads recorded by the probe trace through a model of a cache hierarchy, to estimate how the search
+// functions would do on hardware that isn't at hand. The list is taken to start at address 0.
 
-                    // make a column for the sampling sequence itself
-                    csv[0].push_back("Sequence");
-                    for (size_t numValues = 1; numValues <= c_maxNumValues; ++numValues)
-                    {
-                        sprintf_s(buffer, "%zu", values[numValues-1]);
-                        csv[numValues].push_back(buffer);
-                    }
+struct CacheSimConfig
+{
+    size_t lineSize = c_cacheLineSize;
+    size_t pageSize = c_pageSize;
+    size_t sizes[c_cacheSimNumLevels] = { 32 * 1024, 1024 * 1024, 32 * 1024 * 1024, 64 }; // bytes for the caches, entries for the TLB
+    size_t ways[c_cacheSimNumLevels] = { 8, 16, 16, 4 };
 
-                    char fileName[256];
-                    sprintf_s(fileName, "out/%s.csv", MakeFns[makeIndex].name);
-                    FILE* file = nullptr;
-                    fopen_s(&file, fileName, "w+b");
+    // how many blocks a level holds. Blocks are lines for the caches and pages for the TLB.
+    size_t NumBlocks(size_t level) const
+    {
+        return level + 1 == c_cacheSimNumLevels ? sizes[level] : sizes[level] / lineSize;
+    }
 
-                    for (const TRow& row : csv)
-                    {
-                        for (const std::string& cell : row)
-                            fprintf(file, "\"%s\",", cell.c_str());
-                        fprintf(file, "\n");
-                    }
+    void Print() const
+    {
+        printf("Cache simulator: %zu byte lines, %zu byte pages", lineSize, pageSize);
+        for (size_t level = 0; level < c_cacheSimNumLevels; ++level)
+            printf(", %s %zu%s %zu way", c_cacheSimLevels[level].name, sizes[level], level + 1 == c_cacheSimNumLevels ? " entries" : " bytes", ways[level]);
+        printf("\n");
+    }
+};
 
-                    fclose(file);
+// One set associative level with least recently used replacement, over block numbers.
+class CacheSimLevel
+{
+public:
+    void Init(size_t numBlocks, size_t ways)
+    {
+        m_ways = Clamp<size_t>(1, std::max<size_t>(numBlocks, 1), ways);
+        m_numSets = std::max<size_t>(numBlocks / m_ways, 1);
+        m_tags.assign(m_numSets * m_ways, 0);
+        m_stamps.assign(m_numSets * m_ways, 0);
+        m_epoch = 0;
+        Clear();
+    }
 
-                    printf("Done with %s\n", MakeFns[makeIndex].name);
+    // Empties the level. Entries are stamped with the epoch they were filled in, and entries from older epochs don't
+    // count, so this doesn't have to touch the arrays. That matters when a big LLC is emptied for every cell.
+    void Clear()
+    {
+        m_epoch++;
+        m_time = 0;
+    }
 
-                    makeIndex = nextRow.fetch_add(1);
-                }
+    // returns true on a hit. A miss brings the block in, replacing the least recently used block of its set.
+    bool Access(uint64_t block)
+    {
+        size_t first = size_t(block % m_numSets) * m_ways;
+        uint64_t now = (m_epoch << 32) | ++m_time;
+        size_t victim = first;
+        for (size_t way = first; way < first + m_ways; ++way)
+        {
+            if ((m_stamps[way] >> 32) == m_epoch && m_tags[way] == block)
+            {
+                m_stamps[way] = now;
+                return true;
             }
-        );
+            // stamps from older epochs are smaller than any from this one, so empty ways get used first
+            if (m_stamps[way] < m_stamps[victim])
+                victim = way;
+        }
+        m_tags[victim] = block;
+        m_stamps[victim] = now;
+        return false;
     }
 
-    for (std::thread& t : threads)
-        t.join();
+private:
+    size_t m_ways = 1;
+    size_t m_numSets = 1;
+    std::vector<uint64_t> m_tags;
+    std::vector<uint64_t> m_stamps; // epoch in the high 32 bits, time of last use in the low 32 bits
+    uint64_t m_epoch = 0;
+    uint64_t m_time = 0;
+};
 
-#endif // MAKE_CSVS()
+// The cache levels are non inclusive: a level is only asked if the level above it missed. Every read also goes through
+// the TLB.
+class CacheSimulator
+{
+public:
+    void Init(const CacheSimConfig& config)
+    {
+        m_lineSize = config.lineSize;
+        m_pageSize = config.pageSize;
+        for (size_t level = 0; level < c_cacheSimNumLevels; ++level)
+            m_levels[level].Init(config.NumBlocks(level), config.ways[level]);
+        Clear();
+    }
 
-    // Do perf tests
+    void Clear()
     {
-        static std::random_device rd("dev/random");
-        static std::seed_seq fullSeed{ rd(), rd(), rd(), rd(), rd(), rd(), rd(), rd() };
-        static std::mt19937 rng(fullSeed);
+        for (size_t level = 0; level < c_cacheSimNumLevels; ++level)
+        {
+            m_levels[level].Clear();
+            m_misses[level] = 0;
+        }
+    }
 
-        std::vector<size_t> values, searchValues;
-        searchValues.resize(c_perfTestNumSearches);
-        values.resize(c_maxNumValues);
+    void Access(uint64_t address)
+    {
+        size_t tlb = c_cacheSimNumLevels - 1;
+        if (!m_levels[tlb].Access(address / m_pageSize))
+            m_misses[tlb]++;
 
-        // make the search values that are going to be used by all the tests
+        uint64_t line = address / m_lineSize;
+        for (size_t level = 0; level < tlb; ++level)
         {
-            std::uniform_int_distribution<size_t> dist(0, c_maxValue);
-            for (size_t & v : searchValues)
-                v = dist(rng);
+            if (m_levels[level].Access(line))
+                break;
+            m_misses[level]++;
         }
+    }
 
-        // binary search, linear search, etc
-        for (size_t testIndex = 0; testIndex < countof(TestFns); ++testIndex)
-        {
-            // quadratic numbers, random numbers, etc
-            double timeTotal = 0.0f;
-            size_t totalGuesses = 0;
-            for (size_t makeIndex = 0; makeIndex < countof(MakeFns); ++makeIndex)
-            {
-                MakeFns[makeIndex].fn(values, c_maxNumValues);
+    // replays the reads of a search of a list of size_t
+    void Replay(const ProbeTrace& trace)
+    {
+        for (size_t index : trace.indices)
+            Access(uint64_t(index) * sizeof(size_t));
+    }
 
-                size_t guesses = 0;
+    uint64_t Misses(size_t level) const
+    {
+        return m_misses[level];
+    }
 
-                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+private:
+    CacheSimLevel m_levels[c_cacheSimNumLevels];
+    uint64_t m_misses[c_cacheSimNumLevels];
+    size_t m_lineSize = c_cacheLineSize;
+    size_t m_pageSize = c_pageSize;
+};
 
-                // do the searches
-                for (size_t searchValue : searchValues)
-                {
-                    TestResults ret = TestFns[testIndex].fn(values, searchValue);
-                    guesses += ret.guesses;
-                    totalGuesses += ret.guesses;
-                }
+// ------------------------ COMMAND LINE ------------------------
 
-                std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+struct Options
+{
+    uint64_t seed = 0;
+    bool seedGiven = false;
+    bool sweep = true;
+    bool perf = true;
+    bool throughput = false;
+    bool tune = false;
+    bool fixedSize = false;
+    bool container = false;
+    bool updates = false;
+    bool timeSeries = false;
+    bool intersect = false;
+    bool writeCSV = true;
+    bool writeBinary = false;
+    bool energy = false;
+    bool trace = false;
+    bool cacheSim = false;
+    bool convergence = false;
+    bool pause = true;          // waits for a key before exiting, so the console window stays open
+    CacheSimConfig cacheSimConfig;
+    size_t numThreads = 0;      // 0 means one per core
+    std::vector<size_t> sizes;  // empty means each mode's default sizes
+    std::vector<MakeListInfo> makeFns;
+    std::vector<TestListInfo> testFns;
+    VerifySampler verifySampler;
+    std::string convertFileName;
+    std::vector<HybridTuning> hybridTunings;
+    std::string compareDirectory;       // baseline results to compare this run's results against, if not empty
+    double regressionThreshold = 0.05;  // how much slower, or how many more guesses, counts as a regression
 
-                std::chrono::duration<double> duration = std::chrono::duration_cast<std::chrono::duration<double>>(end - start);
+    size_t NumThreads() const
+    {
+        return numThreads ? numThreads : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+};
 
-                timeTotal += duration.count();
-                printf("  %s %s : %f seconds\n", TestFns[testIndex].name, MakeFns[makeIndex].name, duration.count());
-            }
+void PrintUsage()
+{
+    printf(
+        "Usage: LinearFitSearch [options]\n"
+        "  --mode=<modes>         comma separated, from sweep, tune, perf, throughput, fixed,\n"
+        "                         container, updates, timeseries and intersect. Default is sweep,perf.\n"
+        "                         tune finds the best hybrid search parameters for each number sequence, writes\n"
+        "                         them to out/HybridTuning.txt, and the perf test times them against the defaults.\n"
+        "                         fixed times the searches that know the list size at compile time against the\n"
+        "                         ones that don't, for lists of 8 to 1024 values, and writes out/FixedSize.csv.\n"
+        "                         container times inserts and finds of lfs::FlatMap against std::map and a flat map\n"
+        "                         that uses std::lower_bound, and writes out/Container.csv.\n"
+        "                         updates times mixes of inserts and finds on lfs::GappedIndex and\n"
+        "                         lfs::LogStructuredIndex against a B+ tree, and writes out/Updates.csv.\n"
+        "                         timeseries appends timestamps to lfs::TimeSeriesIndex and looks up the one before a\n"
+        "                         random time after each append, against line fit on a list made again or appended to,\n"
+        "                         and writes out/TimeSeries.csv\n"
+        "                         intersect times lfs::Intersect against std::set_intersection and galloping, on two\n"
+        "                         and three lists of different sizes, and writes out/Intersect.csv. It runs at %zu\n"
+        "                         values too unless --sizes is given\n"
+        "  --datasets=<names>     comma separated number sequences to use. Default is all of them\n"
+        "  --engines=<names>      comma separated search functions to use. Default is all of them\n"
+        "  --sizes=<sizes>        comma separated list sizes. a-b is every size from a to b, a-b/s steps by s,\n"
+        "                         and a-b*f multiplies by f. Default is 1-%zu for the sweep and %zu otherwise\n"
+        "  --threads=<count>      worker threads for the sweep and throughput test. Default is one per core\n"
+        "  --seed=<number>        repeats an earlier run\n"
+        "  --format=<formats>     csv, binary or csv,binary. What the sweep writes to out/\n"
+        "  --verify-rate=<0-1>    fraction of searches that get verified. Default is 1\n"
+        "  --trace                records every read of the sweep's searches, and adds columns for the distinct\n"
+        "                         cache lines and pages each search touched\n"
+        "  --cache-sim[=<config>] replays the sweep's searches through a simulated cache hierarchy and adds columns for\n"
+        "                         the misses per search of each level. The config is comma separated, from\n"
+        "                         l1=<bytes>/<ways>, l2=, llc=, tlb=<entries>/<ways>, line=<bytes> and page=<bytes>.\n"
+        "                         Sizes take K, M and G. Default is l1=32K/8,l2=1M/16,llc=32M/16,tlb=64/4,line=64,page=4K\n"
+        "  --convergence          records the search window after every step of the sweep's searches, and writes how\n"
+        "                         it shrinks per step to out/Convergence.csv\n"
+        "  --energy               reports the energy used per search in the perf test, from Linux's RAPL counters\n"
+        "  --hybrid-config=<file> loads hybrid search parameters written by --mode=tune, for the perf test\n"
+        "  --compare=<directory>  compares the results in out/ against the results of an earlier run in directory, and\n"
+        "                         exits with 2 if any guess count or perf test time got significantly worse.\n"
+        "                         Uses the seed in the directory's Seed.txt unless --seed is given, and doesn't\n"
+        "                         wait for a key before exiting\n"
+        "  --regression-threshold=<fraction>  how much worse counts as a regression. Default is 0.05\n"
+        "  --convert=<file.lfsr>  turns a binary results file back into a csv next to it, and exits\n"
+        "  --list                 lists the number sequences and search functions, and exits\n"
+        "  --no-pause             exits without waiting for a key\n"
+        "Names are matched ignoring case and spaces, so \"--engines=linefit,hybrid\" works.\n",
+        c_intersectLargeNumValues, c_maxNumValues, c_maxNumValues);
+}
 
-            double timePerGuess = (timeTotal * 1000.0 * 1000.0 * 1000.0f) / double(totalGuesses);
-            printf("%s total : %f seconds  (%zu guesses = %f nanoseconds per guess)\n\n", TestFns[testIndex].name, timeTotal, totalGuesses, timePerGuess);
+// lower case with spaces, dashes and underscores removed, so names are easy to type on a command line
+std::string NormalizeName(const char* name)
+{
+    std::string ret;
+    for (const char* c = name; *c; ++c)
+    {
+        if (*c != ' ' && *c != '-' && *c != '_')
+            ret.push_back(char(tolower((unsigned char)*c)));
+    }
+    return ret;
+}
+
+std::vector<std::string> SplitList(const char* list)
+{
+    std::vector<std::string> ret;
+    std::string item;
+    for (const char* c = list; ; ++c)
+    {
+        if (*c == ',' || *c == 0)
+        {
+            if (!item.empty())
+                ret.push_back(item);
+            item.clear();
+            if (*c == 0)
+                break;
         }
+        else
+            item.push_back(*c);
     }
+    return ret;
+}
 
-    system("pause");
+// The tuned hybrid parameters are a text file with a line per number sequence:
+//   <sequence> <line fit steps> <linear finish threshold> <guard width>
+// Lines starting with # are comments.
+bool LoadHybridTunings(const char* fileName, std::vector<HybridTuning>& tunings)
+{
+    FILE* file = nullptr;
+    fopen_s(&file, fileName, "rb");
+    if (!file)
+    {
+        printf("Could not open %s\n", fileName);
+        return false;
+    }
 
-    return 0;
+    bool ok = true;
+    char line[256];
+    while (ok && fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#' || line[0] == '\n' || line[0] == '\r')
+            continue;
+        char dataset[128];
+        HybridTuning tuning;
+        if (sscanf(line, "%127s %zu %zu %zu", dataset, &tuning.params.lineFitSteps, &tuning.params.linearFinishThreshold, &tuning.params.guardWidth) == 4)
+        {
+            tuning.dataset = NormalizeName(dataset);
+            tunings.push_back(tuning);
+        }
+        else
+        {
+            printf("Bad line in %s: %s", fileName, line);
+            ok = false;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+bool SaveHybridTunings(const char* fileName, const std::vector<HybridTuning>& tunings)
+{
+    FILE* file = nullptr;
+    fopen_s(&file, fileName, "w+b");
+    if (!file)
+        return false;
+    fprintf(file, "# sequence, line fit steps per binary search step, linear finish threshold, guard width\n");
+    for (const HybridTuning& tuning : tunings)
+        fprintf(file, "%s %zu %zu %zu\n", tuning.dataset.c_str(), tuning.params.lineFitSteps, tuning.params.linearFinishThreshold, tuning.params.guardWidth);
+    fclose(file);
+    return true;
+}
+
+// the tuned parameters of a number sequence, or nullptr if it has none. The last ones win.
+const HybridParams* FindHybridTuning(const std::vector<HybridTuning>& tunings, const char* dataset)
+{
+    const HybridParams* ret = nullptr;
+    for (const HybridTuning& tuning : tunings)
+    {
+        if (tuning.dataset == NormalizeName(dataset))
+            ret = &tuning.params;
+    }
+    return ret;
+}
+
+// picks the registered entries named in a comma separated list, in registry order. Returns false if a name is unknown.
+template <typename TInfo>
+bool SelectByName(const std::vector<TInfo>& registry, const char* list, std::vector<TInfo>& selected, const char* kind)
+{
+    std::vector<std::string> names = SplitList(list);
+    std::vector<bool> wanted(registry.size(), false);
+    for (const std::string& name : names)
+    {
+        bool found = false;
+        for (size_t index = 0; index < registry.size(); ++index)
+        {
+            if (NormalizeName(registry[index].name) == NormalizeName(name.c_str()))
+            {
+                wanted[index] = true;
+                found = true;
+            }
+        }
+        if (!found)
+        {
+            printf("Unknown %s \"%s\". Use --list to see them all.\n", kind, name.c_str());
+            return false;
+        }
+    }
+
+    selected.clear();
+    for (size_t index = 0; index < registry.size(); ++index)
+    {
+        if (wanted[index])
+            selected.push_back(registry[index]);
+    }
+    return true;
+}
+
+bool ParseSizes(const char* list, std::vector<size_t>& sizes)
+{
+    sizes.clear();
+    for (const std::string& item : SplitList(list))
+    {
+        char* end = nullptr;
+        size_t first = strtoull(item.c_str(), &end, 0);
+        size_t last = first;
+        char stepKind = '/';
+        double step = 1.0;
+        if (*end == '-')
+        {
+            last = strtoull(end + 1, &end, 0);
+            if (*end == '/' || *end == '*')
+            {
+                stepKind = *end;
+                step = strtod(end + 1, &end);
+            }
+        }
+        if (*end != 0 || first == 0 || last < first || (stepKind == '/' && step < 1.0) || (stepKind == '*' && step <= 1.0))
+        {
+            printf("Bad size \"%s\"\n", item.c_str());
+            return false;
+        }
+
+        for (double size = double(first); size <= double(last); size = stepKind == '/' ? size + step : std::max(size * step, size + 1.0))
+            sizes.push_back(size_t(size));
+    }
+
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    return !sizes.empty();
+}
+
+// a number with an optional K, M or G suffix
+size_t ParseByteSize(const char* text, const char** end)
+{
+    char* numberEnd = nullptr;
+    size_t ret = strtoull(text, &numberEnd, 0);
+    switch (toupper((unsigned char)*numberEnd))
+    {
+        case 'K': ret <<= 10; numberEnd++; break;
+        case 'M': ret <<= 20; numberEnd++; break;
+        case 'G': ret <<= 30; numberEnd++; break;
+    }
+    *end = numberEnd;
+    return ret;
+}
+
+bool ParseCacheSimConfig(const char* list, CacheSimConfig& config)
+{
+    for (const std::string& item : SplitList(list))
+    {
+        size_t equals = item.find('=');
+        std::string name = NormalizeName(item.substr(0, equals).c_str());
+        const char* end = equals == std::string::npos ? item.c_str() : item.c_str() + equals + 1;
+        size_t value = ParseByteSize(end, &end);
+
+        bool ok = equals != std::string::npos && value > 0;
+        if (name == "line")
+            config.lineSize = value;
+        else if (name == "page")
+            config.pageSize = value;
+        else
+        {
+            size_t level = 0;
+            while (level < c_cacheSimNumLevels && NormalizeName(c_cacheSimLevels[level].name) != name)
+                level++;
+            if (level == c_cacheSimNumLevels)
+                ok = false;
+            else
+            {
+                config.sizes[level] = value;
+                if (*end == '/')
+                    config.ways[level] = ParseByteSize(end + 1, &end);
+                ok = ok && config.ways[level] > 0;
+            }
+        }
+
+        if (!ok || *end != 0)
+        {
+            printf("Bad cache setting \"%s\"\n", item.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false if the program should exit, with exitCode set
+bool ParseCommandLine(int argc, char** argv, Options& options, int& exitCode)
+{
+    exitCode = 0;
+    options.makeFns = MakeListRegistry();
+    options.testFns = TestListRegistry();
+
+    for (int argIndex = 1; argIndex < argc; ++argIndex)
+    {
+        const char* arg = argv[argIndex];
+        bool ok = true;
+        if (!strncmp(arg, "--seed=", 7))
+        {
+            options.seed = strtoull(arg + 7, nullptr, 0);
+            options.seedGiven = true;
+        }
+        else if (!strncmp(arg, "--mode=", 7))
+        {
+            options.sweep = options.perf = options.throughput = false;
+            for (const std::string& mode : SplitList(arg + 7))
+            {
+                if (mode == "sweep")
+                    options.sweep = true;
+                else if (mode == "perf")
+                    options.perf = true;
+                else if (mode == "throughput")
+                    options.throughput = true;
+                else if (mode == "tune")
+                    options.tune = true;
+                else if (mode == "fixed")
+                    options.fixedSize = true;
+                else if (mode == "container")
+                    options.container = true;
+                else if (mode == "updates")
+                    options.updates = true;
+                else if (mode == "timeseries")
+                    options.timeSeries = true;
+                else if (mode == "intersect")
+                    options.intersect = true;
+                else
+                    ok = false;
+            }
+        }
+        else if (!strncmp(arg, "--datasets=", 11))
+        {
+            ok = SelectByName(MakeListRegistry(), arg + 11, options.makeFns, "dataset");
+        }
+        else if (!strncmp(arg, "--engines=", 10))
+        {
+            ok = SelectByName(TestListRegistry(), arg + 10, options.testFns, "engine");
+        }
+        else if (!strncmp(arg, "--sizes=", 8))
+        {
+            ok = ParseSizes(arg + 8, options.sizes);
+        }
+        else if (!strncmp(arg, "--threads=", 10))
+        {
+            options.numThreads = strtoull(arg + 10, nullptr, 0);
+        }
+        else if (!strncmp(arg, "--format=", 9))
+        {
+            options.writeCSV = strstr(arg + 9, "csv") != nullptr;
+            options.writeBinary = strstr(arg + 9, "binary") != nullptr;
+        }
+        else if (!strncmp(arg, "--verify-rate=", 14))
+        {
+            options.verifySampler.SetRate(atof(arg + 14));
+        }
+        else if (!strncmp(arg, "--hybrid-config=", 16))
+        {
+            ok = LoadHybridTunings(arg + 16, options.hybridTunings);
+        }
+        else if (!strncmp(arg, "--compare=", 10))
+        {
+            options.compareDirectory = arg + 10;
+        }
+        else if (!strncmp(arg, "--regression-threshold=", 23))
+        {
+            options.regressionThreshold = atof(arg + 23);
+        }
+        else if (!strncmp(arg, "--convert=", 10))
+        {
+            options.convertFileName = arg + 10;
+        }
+        else if (!strcmp(arg, "--no-pause"))
+        {
+            options.pause = false;
+        }
+        else if (!strcmp(arg, "--trace"))
+        {
+            options.trace = true;
+        }
+        else if (!strcmp(arg, "--cache-sim"))
+        {
+            options.cacheSim = true;
+        }
+        else if (!strncmp(arg, "--cache-sim=", 12))
+        {
+            options.cacheSim = true;
+            ok = ParseCacheSimConfig(arg + 12, options.cacheSimConfig);
+        }
+        else if (!strcmp(arg, "--convergence"))
+        {
+            options.convergence = true;
+        }
+        else if (!strcmp(arg, "--energy"))
+        {
+            options.energy = true;
+        }
+        else if (!strcmp(arg, "--list"))
+        {
+            printf("Datasets:\n");
+            for (const MakeListInfo& info : MakeListRegistry())
+                printf("  %s\n", info.name);
+            printf("Engines:\n");
+            for (const TestListInfo& info : TestListRegistry())
+                printf("  %s\n", info.name);
+            return false;
+        }
+        else
+        {
+            ok = false;
+        }
+
+        if (!ok)
+        {
+            printf("Bad argument: %s\n\n", arg);
+            PrintUsage();
+            exitCode = 1;
+            return false;
+        }
+    }
+
+    if (options.makeFns.empty() || options.testFns.empty())
+    {
+        printf("Nothing to do, no datasets or no engines were selected.\n");
+        exitCode = 1;
+        return false;
+    }
+
+    return true;
+}
+
+// ------------------------ TIMING ------------------------
+
+// Times with the time stamp counter where there is one, calibrated against the steady clock, and with the steady clock
+// everywhere else.
+struct CycleTimer
+{
+    static const char* Name()
+    {
+        #if LFS_HAS_RDTSCP()
+        return "rdtscp";
+        #else
+        return "steady_clock";
+        #endif
+    }
+
+    static uint64_t Now()
+    {
+        #if LFS_HAS_RDTSCP()
+        unsigned int aux;
+        return __rdtscp(&aux);
+        #else
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        #endif
+    }
+
+    // calibrated the first time it's called, by counting ticks over a fixed amount of steady clock time
+    static double TicksPerSecond()
+    {
+        static const double s_ticksPerSecond = []()
+        {
+            #if LFS_HAS_RDTSCP()
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            uint64_t startTicks = Now();
+            std::chrono::steady_clock::time_point end;
+            do
+            {
+                end = std::chrono::steady_clock::now();
+            }
+            while (end - start < std::chrono::milliseconds(100));
+            uint64_t endTicks = Now();
+            return double(endTicks - startTicks) / std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+            #else
+            return 1000000000.0;
+            #endif
+        }();
+        return s_ticksPerSecond;
+    }
+
+    static double Seconds(uint64_t ticks)
+    {
+        return double(ticks) / TicksPerSecond();
+    }
+};
+
+// Keeps the compiler from throwing away a value that is computed only to be timed
+#if defined(_MSC_VER)
+static const volatile void* volatile s_doNotOptimizeSink;
+
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+    s_doNotOptimizeSink = &value;
+    _ReadWriteBarrier();
+}
+
+// Keeps the compiler from moving memory reads and writes across this point
+inline void ClobberMemory()
+{
+    _ReadWriteBarrier();
+}
+#else
+template <typename T>
+inline void DoNotOptimize(const T& value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Keeps the compiler from moving memory reads and writes across this point
+inline void ClobberMemory()
+{
+    asm volatile("" : : : "memory");
+}
+#endif
+
+template <TestListFn Search>
+void SearchPass(const std::vector<size_t>& values, const size_t* searchValues, size_t count)
+{
+    for (size_t index = 0; index < count; ++index)
+        DoNotOptimize(Search(values, searchValues[index]));
+}
+
+// Times calls of pass, and returns the median call in seconds
+template <typename TPass>
+double TimePasses(const TPass& pass, size_t numRuns)
+{
+    std::vector<uint64_t> runTicks(numRuns);
+    for (uint64_t& ticks : runTicks)
+    {
+        ClobberMemory();
+        uint64_t start = CycleTimer::Now();
+
+        pass();
+
+        ClobberMemory();
+        ticks = CycleTimer::Now() - start;
+    }
+    std::sort(runTicks.begin(), runTicks.end());
+    return CycleTimer::Seconds(runTicks[numRuns / 2]);
+}
+
+// Times passes over the searches, and returns the median pass in seconds
+double TimeSearches(SearchPassFn pass, const std::vector<size_t>& values, const std::vector<size_t>& searchValues, size_t numRuns)
+{
+    return TimePasses([&]() { pass(values, searchValues.data(), searchValues.size()); }, numRuns);
+}
+
+// Times passes over the searches with a hybrid index and the parameters it carries, and returns the median pass in
+// seconds
+double TimeHybridSearches(const lfs::HybridIndex<size_t>& index, const std::vector<size_t>& searchValues, size_t numRuns)
+{
+    return TimePasses([&]()
+    {
+        for (size_t searchValue : searchValues)
+            DoNotOptimize(index.Search(searchValue));
+    }, numRuns);
+}
+
+// Keeps the calling thread on the CPU it's running on now, until it goes out of scope and the CPUs the thread could run
+// on before are put back. Threads started while it's pinned inherit the one CPU, so every test that pins does it with
+// one of these. Pinned() is false if that isn't supported.
+class ScopedThreadPin
+{
+public:
+    ScopedThreadPin()
+    {
+        #if defined(_WIN32)
+        m_previousMask = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << GetCurrentProcessorNumber());
+        m_pinned = m_previousMask != 0;
+        #elif defined(__linux__)
+        int cpu = sched_getcpu();
+        if (cpu < 0 || pthread_getaffinity_np(pthread_self(), sizeof(m_previousSet), &m_previousSet) != 0)
+            return;
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        m_pinned = pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+        #endif
+    }
+
+    ~ScopedThreadPin()
+    {
+        if (!m_pinned)
+            return;
+        #if defined(_WIN32)
+        SetThreadAffinityMask(GetCurrentThread(), m_previousMask);
+        #elif defined(__linux__)
+        pthread_setaffinity_np(pthread_self(), sizeof(m_previousSet), &m_previousSet);
+        #endif
+    }
+
+    ScopedThreadPin(const ScopedThreadPin&) = delete;
+    ScopedThreadPin& operator=(const ScopedThreadPin&) = delete;
+
+    bool Pinned() const
+    {
+        return m_pinned;
+    }
+
+private:
+    bool m_pinned = false;
+    #if defined(_WIN32)
+    DWORD_PTR m_previousMask = 0;
+    #elif defined(__linux__)
+    cpu_set_t m_previousSet;
+    #endif
+};
+
+// ------------------------ ENERGY ------------------------
+
+// Reads the RAPL energy counters that Linux exposes in /sys/class/powercap. There is a domain per CPU package, and
+// most packages have sub domains such as the cores and dram. Elsewhere, or when the counters can't be read (they are
+// often only readable by root), Open() returns false and the perf test goes without.
+class EnergyMeter
+{
+public:
+    struct Domain
+    {
+        std::string name;
+        std::string energyFileName;
+        uint64_t maxEnergy;     // the counter wraps around after this many microjoules
+    };
+
+    bool Open()
+    {
+        m_domains.clear();
+        for (int package = 0; package < 64; ++package)
+        {
+            char path[256];
+            sprintf_s(path, "/sys/class/powercap/intel-rapl:%i", package);
+            if (!AddDomain(path))
+                break;
+
+            for (int subDomain = 0; subDomain < 64; ++subDomain)
+            {
+                sprintf_s(path, "/sys/class/powercap/intel-rapl:%i:%i", package, subDomain);
+                if (!AddDomain(path))
+                    break;
+            }
+        }
+        return !m_domains.empty();
+    }
+
+    const std::vector<Domain>& Domains() const
+    {
+        return m_domains;
+    }
+
+    // the current counter of every domain, in microjoules
+    std::vector<uint64_t> Read() const
+    {
+        std::vector<uint64_t> ret(m_domains.size(), 0);
+        for (size_t index = 0; index < m_domains.size(); ++index)
+            ReadNumber(m_domains[index].energyFileName.c_str(), ret[index]);
+        return ret;
+    }
+
+    // microjoules used by a domain between two reads
+    uint64_t Used(size_t domainIndex, uint64_t before, uint64_t after) const
+    {
+        if (after >= before)
+            return after - before;
+        return m_domains[domainIndex].maxEnergy - before + after + 1;
+    }
+
+private:
+    static bool ReadNumber(const char* fileName, uint64_t& value)
+    {
+        FILE* file = nullptr;
+        fopen_s(&file, fileName, "rb");
+        if (!file)
+            return false;
+        unsigned long long number = 0;
+        bool ok = fscanf(file, "%llu", &number) == 1;
+        fclose(file);
+        value = number;
+        return ok;
+    }
+
+    bool AddDomain(const char* path)
+    {
+        Domain domain;
+        domain.energyFileName = std::string(path) + "/energy_uj";
+
+        uint64_t energy;
+        if (!ReadNumber(domain.energyFileName.c_str(), energy) || !ReadNumber((std::string(path) + "/max_energy_range_uj").c_str(), domain.maxEnergy))
+            return false;
+
+        char name[256] = { 0 };
+        FILE* file = nullptr;
+        fopen_s(&file, (std::string(path) + "/name").c_str(), "rb");
+        if (file)
+        {
+            if (fgets(name, sizeof(name), file))
+                name[strcspn(name, "\r\n")] = 0;
+            fclose(file);
+        }
+        domain.name = name[0] ? name : path;
+
+        m_domains.push_back(domain);
+        return true;
+    }
+
+    std::vector<Domain> m_domains;
+};
+
+// ------------------------ PARETO REPORT ------------------------
+// Once engines build indices, build time, memory and lookup time pull against each other. An engine is on the Pareto
+// front of a number sequence and size if no other engine is at least as good at all three, and better at one.
+
+struct ParetoPoint
+{
+    const char* dataset;
+    size_t numValues;
+    const char* engine;
+    double buildSeconds;
+    double bytesPerKey;         // memory on top of the list itself
+    double lookupNanoseconds;   // per search
+};
+
+bool ParetoDominates(const ParetoPoint& a, const ParetoPoint& b)
+{
+    bool noWorse = a.buildSeconds <= b.buildSeconds && a.bytesPerKey <= b.bytesPerKey && a.lookupNanoseconds <= b.lookupNanoseconds;
+    bool better = a.buildSeconds < b.buildSeconds || a.bytesPerKey < b.bytesPerKey || a.lookupNanoseconds < b.lookupNanoseconds;
+    return noWorse && better;
+}
+
+// writes a row per point to the csv, and prints the front of each number sequence and size
+void ReportParetoFront(const std::vector<ParetoPoint>& points, CSVWriter& csv)
+{
+    auto SameList = [](const ParetoPoint& a, const ParetoPoint& b)
+    {
+        return !strcmp(a.dataset, b.dataset) && a.numValues == b.numValues;
+    };
+
+    std::vector<bool> reported(points.size(), false);
+    for (size_t first = 0; first < points.size(); ++first)
+    {
+        if (reported[first])
+            continue;
+
+        printf("  Pareto front of %s (%zu values) :", points[first].dataset, points[first].numValues);
+        const char* separator = " ";
+        for (size_t index = first; index < points.size(); ++index)
+        {
+            const ParetoPoint& point = points[index];
+            if (!SameList(point, points[first]))
+                continue;
+            reported[index] = true;
+
+            bool front = true;
+            for (const ParetoPoint& other : points)
+            {
+                if (SameList(other, point) && ParetoDominates(other, point))
+                    front = false;
+            }
+            if (front)
+            {
+                printf("%s%s", separator, point.engine);
+                separator = ", ";
+            }
+
+            if (csv.file)
+            {
+                csv.Cell(point.dataset);
+                csv.Cell(point.numValues);
+                csv.Cell(point.engine);
+                csv.Cell(point.buildSeconds * 1000000000.0);
+                csv.Cell(point.bytesPerKey);
+                csv.Cell(point.lookupNanoseconds);
+                csv.Cell(front ? "Yes" : "No");
+                csv.EndRow();
+            }
+        }
+        printf("\n");
+    }
+    printf("\n");
+}
+
+// ------------------------ REGRESSION GATE ------------------------
+// Compares the results of a run against the results of an earlier one. Something is a regression when it got worse by
+// at least the threshold, and the bootstrapped 95% confidence interval of new / old is entirely above 1, so that noise
+// doesn't set it off.
+
+// Reads a csv written by CSVWriter, quoted cells separated by commas with a row of titles first. Returns false if the
+// file couldn't be read.
+bool LoadResultsCSV(const char* fileName, ResultsTable& table)
+{
+    FILE* file = nullptr;
+    fopen_s(&file, fileName, "rb");
+    if (!file)
+        return false;
+    std::string text;
+    {
+        char buffer[65536];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+            text.append(buffer, count);
+    }
+    fclose(file);
+
+    table.numRows = 0;
+    table.columns.clear();
+
+    size_t rowIndex = 0;
+    size_t columnIndex = 0;
+    std::string cell;
+    bool quoted = false;
+    bool cellStarted = false;
+    auto EndCell = [&]()
+    {
+        if (rowIndex == 0)
+        {
+            table.columns.emplace_back();
+            table.columns.back().name = cell;
+            table.columns.back().type = BinaryColumnType::F64;
+        }
+        else if (columnIndex < table.columns.size())
+        {
+            table.columns[columnIndex].text.push_back(cell);
+            table.columns[columnIndex].values.push_back(strtod(cell.c_str(), nullptr));
+        }
+        columnIndex++;
+        cell.clear();
+        cellStarted = false;
+    };
+    auto EndRow = [&]()
+    {
+        if (cellStarted)
+            EndCell();
+        if (columnIndex == 0)
+            return;
+        if (rowIndex > 0)
+        {
+            // short rows get empty cells
+            for (; columnIndex < table.columns.size(); ++columnIndex)
+            {
+                table.columns[columnIndex].text.push_back(std::string());
+                table.columns[columnIndex].values.push_back(0.0);
+            }
+            table.numRows++;
+        }
+        rowIndex++;
+        columnIndex = 0;
+    };
+
+    for (char c : text)
+    {
+        if (c == '"')
+        {
+            quoted = !quoted;
+            cellStarted = true;
+        }
+        else if (c == ',' && !quoted)
+            EndCell();
+        else if (c == '\n' && !quoted)
+            EndRow();
+        else if (c != '\r')
+        {
+            cell.push_back(c);
+            cellStarted = true;
+        }
+    }
+    EndRow();
+    return !table.columns.empty();
+}
+
+// Loads <directory>/<dataset>.lfsr, or <directory>/<dataset>.csv when binary results aren't wanted or aren't there
+bool LoadDatasetResults(const std::string& directory, const char* dataset, bool preferBinary, ResultsTable& table)
+{
+    std::string fileName = directory + "/" + dataset;
+    if (preferBinary && LoadResultsBinary((fileName + ".lfsr").c_str(), table))
+        return true;
+    return LoadResultsCSV((fileName + ".csv").c_str(), table);
+}
+
+// One side of a comparison. When only a summary of the samples is known, like a csv cell that has no histogram, the
+// bootstrap falls back to the normal approximation of the distribution of the mean.
+struct BootstrapSamples
+{
+    std::vector<double> values;
+    double mean = 0.0;
+    double stdDev = 0.0;
+    size_t count = 0;
+
+    double ResampleMean(RNG& rng) const
+    {
+        if (!values.empty())
+        {
+            double sum = 0.0;
+            for (size_t index = 0; index < values.size(); ++index)
+                sum += values[rng.Range(0, values.size() - 1)];
+            return sum / double(values.size());
+        }
+
+        // Box-Muller
+        double u1 = (double(rng.Next() >> 11) + 1.0) / 9007199254740992.0;
+        double u2 = double(rng.Next() >> 11) / 9007199254740992.0;
+        double normal = sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+        return mean + normal * stdDev / sqrt(double(std::max<size_t>(count, 1)));
+    }
+};
+
+struct RatioInterval
+{
+    double estimate;
+    double low;
+    double high;
+};
+
+// the 95% confidence interval of mean(current) / mean(baseline)
+RatioInterval BootstrapRatio(const BootstrapSamples& baseline, const BootstrapSamples& current, RNG& rng)
+{
+    std::vector<double> ratios;
+    ratios.reserve(c_bootstrapResamples);
+    for (size_t resample = 0; resample < c_bootstrapResamples; ++resample)
+    {
+        double baselineMean = baseline.ResampleMean(rng);
+        double currentMean = current.ResampleMean(rng);
+        if (baselineMean > 0.0)
+            ratios.push_back(currentMean / baselineMean);
+    }
+
+    RatioInterval ret;
+    ret.estimate = current.mean / baseline.mean;
+    ret.low = ret.high = ret.estimate;
+    if (!ratios.empty())
+    {
+        std::sort(ratios.begin(), ratios.end());
+        ret.low = ratios[size_t(0.025 * double(ratios.size() - 1))];
+        ret.high = ratios[size_t(0.975 * double(ratios.size() - 1))];
+    }
+    return ret;
+}
+
+// The guesses of a cell of the sweep's results. A histogram gives the guess count of every search to within its bucket,
+// and the samples are shifted so that they have the cell's exact mean.
+BootstrapSamples CellSamples(const ResultsTable& table, const char* engine, size_t row)
+{
+    BootstrapSamples ret;
+    const ResultsTable::Column* avg = table.Find(std::string(engine) + " Avg");
+    const ResultsTable::Column* stdDev = table.Find(std::string(engine) + " StdDev");
+    const ResultsTable::Column* histogram = table.Find(std::string(engine) + " Histogram");
+    ret.mean = avg->values[row];
+    ret.stdDev = stdDev ? stdDev->values[row] : 0.0;
+    ret.count = c_numRunsPerTest;
+
+    if (histogram && histogram->type == BinaryColumnType::Histogram)
+    {
+        const uint32_t* counts = &histogram->histograms[row * histogram->numBuckets];
+        for (size_t bucket = 0; bucket < histogram->numBuckets; ++bucket)
+            ret.values.insert(ret.values.end(), counts[bucket], double(GuessHistogram::BucketMin(bucket)));
+        if (!ret.values.empty())
+        {
+            double shift = ret.mean;
+            for (double value : ret.values)
+                shift -= value / double(ret.values.size());
+            for (double& value : ret.values)
+                value += shift;
+            ret.count = ret.values.size();
+        }
+    }
+    return ret;
+}
+
+// Compares the guesses of the sweep and the times of the perf test, whichever this run did, against the results in
+// options.compareDirectory. Returns how many regressions were found.
+size_t CompareWithBaseline(const Options& options, uint64_t compareSeed)
+{
+    RNG rng(compareSeed);
+    const double limit = 1.0 + options.regressionThreshold;
+    size_t numCompared = 0;
+    size_t numRegressions = 0;
+    printf("Comparing against %s\n", options.compareDirectory.c_str());
+
+    // Only results that are worse by the threshold get bootstrapped, which keeps a full sweep quick to compare. Cells
+    // where the baseline made no guesses at all have no ratio, and are skipped.
+    auto Check = [&](const char* what, const char* dataset, size_t numValues, const char* engine, const BootstrapSamples& baseline, const BootstrapSamples& current)
+    {
+        numCompared++;
+        if (baseline.mean <= 0.0 || current.mean < baseline.mean * limit)
+            return;
+        RatioInterval interval = BootstrapRatio(baseline, current, rng);
+        if (interval.low <= 1.0)
+            return;
+        numRegressions++;
+        printf("  REGRESSION %s %s (%zu values) %s : %f -> %f, %+.1f%% (95%% confidence %+.1f%% to %+.1f%%)\n",
+            engine, dataset, numValues, what, baseline.mean, current.mean,
+            (interval.estimate - 1.0) * 100.0, (interval.low - 1.0) * 100.0, (interval.high - 1.0) * 100.0);
+    };
+
+    // guesses per cell, from the sweep. Cells are matched up by sample count.
+    if (options.sweep)
+    {
+        for (const MakeListInfo& makeFn : options.makeFns)
+        {
+            ResultsTable baseline;
+            ResultsTable current;
+            if (!LoadDatasetResults(options.compareDirectory, makeFn.name, true, baseline))
+            {
+                printf("  No baseline results for %s\n", makeFn.name);
+                continue;
+            }
+            if (!LoadDatasetResults("out", makeFn.name, options.writeBinary, current))
+                continue;
+            const ResultsTable::Column* baselineSizes = baseline.Find("Sample Count");
+            const ResultsTable::Column* currentSizes = current.Find("Sample Count");
+            if (!baselineSizes || !currentSizes)
+                continue;
+
+            for (const TestListInfo& testFn : options.testFns)
+            {
+                std::string avg = std::string(testFn.name) + " Avg";
+                if (!baseline.Find(avg) || !current.Find(avg))
+                    continue;
+
+                size_t baselineRow = 0;
+                for (size_t row = 0; row < current.numRows; ++row)
+                {
+                    double numValues = currentSizes->values[row];
+                    while (baselineRow < baseline.numRows && baselineSizes->values[baselineRow] < numValues)
+                        baselineRow++;
+                    if (baselineRow == baseline.numRows || baselineSizes->values[baselineRow] != numValues)
+                        continue;
+                    Check("guesses", makeFn.name, size_t(numValues), testFn.name, CellSamples(baseline, testFn.name, baselineRow), CellSamples(current, testFn.name, row));
+                }
+            }
+        }
+    }
+
+    // nanoseconds per search, from the timed passes of the perf test
+    if (options.perf)
+    {
+        struct PerfCell
+        {
+            std::string dataset;
+            size_t numValues;
+            std::string engine;
+            BootstrapSamples runs;
+        };
+        auto Gather = [](const ResultsTable& table, std::vector<PerfCell>& cells)
+        {
+            const ResultsTable::Column* dataset = table.Find("Dataset");
+            const ResultsTable::Column* numValues = table.Find("Sample Count");
+            const ResultsTable::Column* engine = table.Find("Engine");
+            const ResultsTable::Column* nanoseconds = table.Find("ns Per Search");
+            if (!dataset || !numValues || !engine || !nanoseconds)
+                return;
+            for (size_t row = 0; row < table.numRows; ++row)
+            {
+                PerfCell* cell = nullptr;
+                for (PerfCell& existing : cells)
+                {
+                    if (existing.dataset == dataset->text[row] && existing.numValues == size_t(numValues->values[row]) && existing.engine == engine->text[row])
+                        cell = &existing;
+                }
+                if (!cell)
+                {
+                    cells.push_back({ dataset->text[row], size_t(numValues->values[row]), engine->text[row], BootstrapSamples() });
+                    cell = &cells.back();
+                }
+                cell->runs.values.push_back(nanoseconds->values[row]);
+            }
+            for (PerfCell& cell : cells)
+            {
+                cell.runs.count = cell.runs.values.size();
+                cell.runs.mean = 0.0;
+                for (double value : cell.runs.values)
+                    cell.runs.mean += value / double(cell.runs.count);
+            }
+        };
+
+        ResultsTable baselineTable;
+        ResultsTable currentTable;
+        std::vector<PerfCell> baseline;
+        std::vector<PerfCell> current;
+        if (!LoadResultsCSV((options.compareDirectory + "/Perf.csv").c_str(), baselineTable))
+            printf("  No baseline perf test results\n");
+        else if (LoadResultsCSV("out/Perf.csv", currentTable))
+        {
+            Gather(baselineTable, baseline);
+            Gather(currentTable, current);
+            for (const PerfCell& cell : current)
+            {
+                for (const PerfCell& before : baseline)
+                {
+                    if (before.dataset == cell.dataset && before.numValues == cell.numValues && before.engine == cell.engine)
+                        Check("ns per search", cell.dataset.c_str(), cell.numValues, cell.engine.c_str(), before.runs, cell.runs);
+                }
+            }
+        }
+    }
+
+    printf("Compared %zu results, %zu regressions\n\n", numCompared, numRegressions);
+    return numRegressions;
+}
+
+// ------------------------ MAIN ------------------------
+
+void RunSweep(const Options& options, uint64_t sweepSeed)
+{
+    const std::vector<MakeListInfo>& MakeFns = options.makeFns;
+    const std::vector<TestListInfo>& TestFns = options.testFns;
+
+    std::vector<size_t> sizes = options.sizes;
+    if (sizes.empty())
+    {
+        for (size_t numValues = 1; numValues <= c_maxNumValues; ++numValues)
+            sizes.push_back(numValues);
+    }
+
+    if (options.cacheSim)
+        options.cacheSimConfig.Print();
+
+    // The sweep is split into tasks of (number sequence, search function, range of sample counts) so that every core
+    // has something to do, instead of handing out one number sequence per thread. Each task writes only its own cells
+    // of the results, so the sheets come out the same no matter which thread ran which task.
+    struct SweepTask
+    {
+        size_t makeIndex;
+        size_t testIndex;
+        size_t sizeIndexBegin;
+        size_t sizeIndexEnd;
+    };
+
+    // Tasks are handed out in order of sample count, so the rows of each csv finish roughly in order and can be written
+    // as they complete. Tasks are small enough that the big sample counts at the end don't leave a long tail.
+    std::vector<SweepTask> tasks;
+    for (size_t chunkBegin = 0; chunkBegin < sizes.size(); chunkBegin += c_sweepTaskNumValues)
+    {
+        size_t chunkEnd = std::min(chunkBegin + c_sweepTaskNumValues, sizes.size());
+        for (size_t makeIndex = 0; makeIndex < MakeFns.size(); ++makeIndex)
+        {
+            for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+                tasks.push_back({ makeIndex, testIndex, chunkBegin, chunkEnd });
+        }
+    }
+
+    // results[makeIndex][testIndex][sizeIndex]
+    std::vector<GuessStats> results(MakeFns.size() * TestFns.size() * sizes.size());
+    std::vector<ConvergenceStats> convergence(options.convergence ? results.size() : 0);
+
+    // Lists that only depend on the count are made once per (number sequence, sample count) and shared by every search
+    // function and every repeat. A cached list is freed once all of the search functions are done with it. Tasks are
+    // ordered so the search functions for the same sample counts run around the same time, which keeps this small.
+    struct CachedList
+    {
+        std::once_flag made;
+        std::vector<size_t> values;
+        std::atomic<size_t> usesRemaining;
+    };
+    std::vector<CachedList> listCache(MakeFns.size() * sizes.size());
+    for (CachedList& cached : listCache)
+        cached.usesRemaining = TestFns.size();
+
+    size_t numThreads = std::min(options.NumThreads(), tasks.size());
+    std::vector<std::thread> threads;
+    threads.resize(numThreads);
+
+    // The csv of each number sequence. A row is written once every search function has finished that sample count and
+    // all of the rows before it have been written.
+    struct Sheet
+    {
+        std::mutex lock;
+        CSVWriter csv;
+        std::vector<size_t> sequence;
+        size_t nextRow = 0;
+        std::vector<std::atomic<size_t>> testsRemaining;
+    };
+    std::vector<Sheet> sheets(MakeFns.size());
+    for (size_t makeIndex = 0; makeIndex < MakeFns.size(); ++makeIndex)
+    {
+        Sheet& sheet = sheets[makeIndex];
+
+        sheet.testsRemaining = std::vector<std::atomic<size_t>>(sizes.size());
+        for (std::atomic<size_t>& remaining : sheet.testsRemaining)
+            remaining = TestFns.size();
+
+        // the sampling sequence itself gets a column too
+        RNG rng(DeriveSeed(DeriveSeed(sweepSeed, HashName(MakeFns[makeIndex].name)), ~uint64_t(0)));
+        MakeFns[makeIndex].fn(sheet.sequence, sizes.back(), rng);
+
+        if (!options.writeCSV)
+            continue;
+
+        char fileName[256];
+        sprintf_s(fileName, "out/%s.csv", MakeFns[makeIndex].name);
+        sheet.csv.Open(fileName);
+
+        // a row of titles
+        sheet.csv.Cell("Sample Count");
+        for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+        {
+            sheet.csv.Cell(TestFns[testIndex].name, " Min");
+            sheet.csv.Cell(TestFns[testIndex].name, " Max");
+            sheet.csv.Cell(TestFns[testIndex].name, " Avg");
+            sheet.csv.Cell(TestFns[testIndex].name, " Single");
+            sheet.csv.Cell(TestFns[testIndex].name, " Variance");
+            sheet.csv.Cell(TestFns[testIndex].name, " StdDev");
+            for (const GuessPercentile& percentile : c_guessPercentiles)
+                sheet.csv.Cell(TestFns[testIndex].name, percentile.nameSuffix);
+            if (options.trace)
+            {
+                sheet.csv.Cell(TestFns[testIndex].name, " Lines Avg");
+                sheet.csv.Cell(TestFns[testIndex].name, " Lines Max");
+                sheet.csv.Cell(TestFns[testIndex].name, " Pages Avg");
+                sheet.csv.Cell(TestFns[testIndex].name, " Pages Max");
+            }
+            if (options.cacheSim)
+            {
+                for (const CacheSimLevelInfo& level : c_cacheSimLevels)
+                    sheet.csv.Cell(TestFns[testIndex].name, level.missesSuffix);
+            }
+        }
+        sheet.csv.Cell("Sequence");
+        sheet.csv.EndRow();
+    }
+
+    // writes the binary results of a number sequence, once all of its rows are done
+    auto WriteBinarySheet = [&](size_t makeIndex)
+    {
+        // histograms only need to go as far as the biggest guess count of each search function
+        std::vector<size_t> numBuckets(TestFns.size(), 0);
+        for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+        {
+            const GuessStats* testStats = &results[(makeIndex * TestFns.size() + testIndex) * sizes.size()];
+            for (size_t index = 0; index < sizes.size(); ++index)
+                numBuckets[testIndex] = std::max(numBuckets[testIndex], GuessHistogram::Bucket(testStats[index].max) + 1);
+        }
+
+        std::vector<BinaryColumn> columns;
+        columns.push_back({ "Sample Count", "", BinaryColumnType::U64, 0 });
+        for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+        {
+            columns.push_back({ TestFns[testIndex].name, " Min", BinaryColumnType::U64, 0 });
+            columns.push_back({ TestFns[testIndex].name, " Max", BinaryColumnType::U64, 0 });
+            columns.push_back({ TestFns[testIndex].name, " Avg", BinaryColumnType::F32, 0 });
+            columns.push_back({ TestFns[testIndex].name, " Single", BinaryColumnType::U64, 0 });
+            columns.push_back({ TestFns[testIndex].name, " Variance", BinaryColumnType::F64, 0 });
+            columns.push_back({ TestFns[testIndex].name, " StdDev", BinaryColumnType::F64, 0 });
+            for (const GuessPercentile& percentile : c_guessPercentiles)
+                columns.push_back({ TestFns[testIndex].name, percentile.nameSuffix, BinaryColumnType::U64, 0 });
+            if (options.trace)
+            {
+                columns.push_back({ TestFns[testIndex].name, " Lines Avg", BinaryColumnType::F32, 0 });
+                columns.push_back({ TestFns[testIndex].name, " Lines Max", BinaryColumnType::U64, 0 });
+                columns.push_back({ TestFns[testIndex].name, " Pages Avg", BinaryColumnType::F32, 0 });
+                columns.push_back({ TestFns[testIndex].name, " Pages Max", BinaryColumnType::U64, 0 });
+            }
+            if (options.cacheSim)
+            {
+                for (const CacheSimLevelInfo& level : c_cacheSimLevels)
+                    columns.push_back({ TestFns[testIndex].name, level.missesSuffix, BinaryColumnType::F32, 0 });
+            }
+            columns.push_back({ TestFns[testIndex].name, " Histogram", BinaryColumnType::Histogram, numBuckets[testIndex] });
+        }
+        columns.push_back({ "Sequence", "", BinaryColumnType::U64, 0 });
+
+        BinaryResultsWriter writer;
+        writer.PutHeader(options.seed, sizes.size(), columns);
+
+        for (size_t numValues : sizes)
+            writer.PutU64(numValues);
+        for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+        {
+            const GuessStats* testStats = &results[(makeIndex * TestFns.size() + testIndex) * sizes.size()];
+            for (size_t index = 0; index < sizes.size(); ++index)
+                writer.PutU64(testStats[index].min);
+            for (size_t index = 0; index < sizes.size(); ++index)
+                writer.PutU64(testStats[index].max);
+            for (size_t index = 0; index < sizes.size(); ++index)
+                writer.PutF32(float(testStats[index].mean));
+            for (size_t index = 0; index < sizes.size(); ++index)
+                writer.PutU64(testStats[index].single);
+            for (size_t index = 0; index < sizes.size(); ++index)
+                writer.PutF64(testStats[index].Variance());
+            for (size_t index = 0; index < sizes.size(); ++index)
+                writer.PutF64(testStats[index].StdDev());
+            for (const GuessPercentile& percentile : c_guessPercentiles)
+            {
+                for (size_t index = 0; index < sizes.size(); ++index)
+                    writer.PutU64(testStats[index].Percentile(percentile.fraction));
+            }
+            if (options.trace)
+            {
+                for (size_t index = 0; index < sizes.size(); ++index)
+                    writer.PutF32(float(testStats[index].cacheLines.mean));
+                for (size_t index = 0; index < sizes.size(); ++index)
+                    writer.PutU64(testStats[index].cacheLines.max);
+                for (size_t index = 0; index < sizes.size(); ++index)
+                    writer.PutF32(float(testStats[index].pages.mean));
+                for (size_t index = 0; index < sizes.size(); ++index)
+                    writer.PutU64(testStats[index].pages.max);
+            }
+            if (options.cacheSim)
+            {
+                for (size_t level = 0; level < c_cacheSimNumLevels; ++level)
+                {
+                    for (size_t index = 0; index < sizes.size(); ++index)
+                        writer.PutF32(float(testStats[index].cacheSimMisses[level]));
+                }
+            }
+            for (size_t index = 0; index < sizes.size(); ++index)
+                writer.PutHistogram(testStats[index].histogram, numBuckets[testIndex]);
+        }
+        for (size_t numValues : sizes)
+            writer.PutU64(sheets[makeIndex].sequence[numValues - 1]);
+
+        char fileName[256];
+        sprintf_s(fileName, "out/%s.lfsr", MakeFns[makeIndex].name);
+        writer.Save(fileName);
+    };
+
+    // called when a sample count of a number sequence is done for every search function
+    auto FinishRow = [&](size_t makeIndex)
+    {
+        Sheet& sheet = sheets[makeIndex];
+        std::lock_guard<std::mutex> lock(sheet.lock);
+        while (sheet.nextRow < sizes.size() && sheet.testsRemaining[sheet.nextRow] == 0)
+        {
+            size_t sizeIndex = sheet.nextRow++;
+            size_t numValues = sizes[sizeIndex];
+            if (options.writeCSV)
+            {
+                sheet.csv.Cell(numValues);
+                for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+                {
+                    const GuessStats& stats = results[(makeIndex * TestFns.size() + testIndex) * sizes.size() + sizeIndex];
+                    sheet.csv.Cell(stats.min);
+                    sheet.csv.Cell(stats.max);
+                    sheet.csv.Cell(float(stats.mean));
+                    sheet.csv.Cell(stats.single);
+                    sheet.csv.Cell(stats.Variance());
+                    sheet.csv.Cell(stats.StdDev());
+                    for (const GuessPercentile& percentile : c_guessPercentiles)
+                        sheet.csv.Cell(stats.Percentile(percentile.fraction));
+                    if (options.trace)
+                    {
+                        sheet.csv.Cell(float(stats.cacheLines.mean));
+                        sheet.csv.Cell(stats.cacheLines.max);
+                        sheet.csv.Cell(float(stats.pages.mean));
+                        sheet.csv.Cell(stats.pages.max);
+                    }
+                    if (options.cacheSim)
+                    {
+                        for (double misses : stats.cacheSimMisses)
+                            sheet.csv.Cell(float(misses));
+                    }
+                }
+                sheet.csv.Cell(sheet.sequence[numValues - 1]);
+                sheet.csv.EndRow();
+            }
+
+            // the last row means the whole sheet is done
+            if (sizeIndex + 1 == sizes.size())
+            {
+                if (options.writeCSV)
+                    sheet.csv.Close();
+                if (options.writeBinary)
+                    WriteBinarySheet(makeIndex);
+                printf("Done with %s\n", MakeFns[makeIndex].name);
+            }
+        }
+    };
+
+    // Done multithreadedly. Threads grab the next task until there are none left.
+    std::atomic<size_t> nextTask(0);
+    std::atomic<size_t> verifyFailures(0);
+    const bool verify = options.verifySampler.Enabled();
+    for (std::thread& t : threads)
+    {
+        t = std::thread(
+            [&]()
+            {
+                std::vector<size_t> randomValues;
+                ProbeTrace probeTrace;
+                const bool recordProbes = options.trace || options.cacheSim || options.convergence;
+                CacheSimulator cacheSim;
+                if (options.cacheSim)
+                    cacheSim.Init(options.cacheSimConfig);
+                size_t taskIndex = nextTask.fetch_add(1);
+                while (taskIndex < tasks.size())
+                {
+                    const SweepTask& task = tasks[taskIndex];
+                    const MakeListInfo& makeFn = MakeFns[task.makeIndex];
+                    const TestListInfo& testFn = TestFns[task.testIndex];
+                    TestListFn search = recordProbes ? testFn.tracedFn : testFn.fn;
+
+                    // for each result
+                    for (size_t sizeIndex = task.sizeIndexBegin; sizeIndex < task.sizeIndexEnd; ++sizeIndex)
+                    {
+                        size_t numValues = sizes[sizeIndex];
+                        GuessStats& stats = results[(task.makeIndex * TestFns.size() + task.testIndex) * sizes.size() + sizeIndex];
+                        stats.Clear();
+
+                        // Each cell has its own stream, so it comes out the same no matter which thread or task runs it. The
+                        // stream is keyed by names rather than indices, so a cell also comes out the same when it's run
+                        // on its own with --datasets, --engines and --sizes.
+                        RNG rng(DeriveSeed(DeriveSeed(DeriveSeed(sweepSeed, HashName(makeFn.name)), HashName(testFn.name)), numValues));
+
+                        CachedList* cached = nullptr;
+                        if (makeFn.deterministic)
+                        {
+                            cached = &listCache[task.makeIndex * sizes.size() + sizeIndex];
+                            std::call_once(cached->made, [&]() { makeFn.fn(cached->values, numValues, rng); });
+                        }
+                        const std::vector<size_t>& values = cached ? cached->values : randomValues;
+
+                        // engines with an index build it once per list
+                        std::unique_ptr<SearchIndex> index;
+                        if (cached && testFn.build)
+                            index = testFn.build(values);
+
+                        // the caches start out empty for each cell, and stay warm across its repeats
+                        if (options.cacheSim)
+                            cacheSim.Clear();
+
+                        // repeat it a number of times to gather statistics
+                        for (size_t repeatIndex = 0; repeatIndex < c_numRunsPerTest; ++repeatIndex)
+                        {
+                            size_t searchValue = rng.Range(0, c_maxValue);
+
+                            if (!cached)
+                            {
+                                makeFn.fn(randomValues, numValues, rng);
+                                if (testFn.build)
+                                    index = testFn.build(values);
+                            }
+
+                            if (recordProbes)
+                            {
+                                probeTrace.Clear();
+                                t_probeTrace = &probeTrace;
+                            }
+                            t_searchIndex = index.get();
+                            TestResults result = search(values, searchValue);
+                            t_probeTrace = nullptr;
+                            t_searchIndex = nullptr;
+
+                            if (options.trace)
+                            {
+                                stats.cacheLines.Add(probeTrace.DistinctBlocks(options.cacheSimConfig.lineSize));
+                                stats.pages.Add(probeTrace.DistinctBlocks(options.cacheSimConfig.pageSize));
+                            }
+                            if (options.cacheSim)
+                                cacheSim.Replay(probeTrace);
+                            if (options.convergence)
+                                convergence[(task.makeIndex * TestFns.size() + task.testIndex) * sizes.size() + sizeIndex].Add(probeTrace.windows);
+
+                            if (verify && options.verifySampler.Sample(numValues * c_numRunsPerTest + repeatIndex) && !VerifyResults(values, searchValue, result, makeFn.name, testFn.name))
+                                verifyFailures++;
+
+                            stats.Add(result.guesses);
+                        }
+
+                        if (options.cacheSim)
+                        {
+                            for (size_t level = 0; level < c_cacheSimNumLevels; ++level)
+                                stats.cacheSimMisses[level] = double(cacheSim.Misses(level)) / double(c_numRunsPerTest);
+                        }
+
+                        if (cached && cached->usesRemaining.fetch_sub(1) == 1)
+                        {
+                            cached->values.clear();
+                            cached->values.shrink_to_fit();
+                        }
+
+                        if (sheets[task.makeIndex].testsRemaining[sizeIndex].fetch_sub(1) == 1)
+                            FinishRow(task.makeIndex);
+                    }
+
+                    taskIndex = nextTask.fetch_add(1);
+                }
+            }
+        );
+    }
+
+    for (std::thread& t : threads)
+        t.join();
+
+    if (verify)
+        printf("Sweep verification failures: %zu\n", size_t(verifyFailures));
+
+    // one row per step of every cell. Search functions that don't narrow a window, like linear search, have no rows.
+    if (options.convergence)
+    {
+        CSVWriter csv;
+        csv.Open("out/Convergence.csv");
+        csv.Cell("Dataset");
+        csv.Cell("Sample Count");
+        csv.Cell("Engine");
+        csv.Cell("Step");
+        csv.Cell("Searches");
+        csv.Cell("Avg Window");
+        csv.Cell("Avg Shrink");
+        csv.EndRow();
+        for (size_t makeIndex = 0; makeIndex < MakeFns.size(); ++makeIndex)
+        {
+            for (size_t sizeIndex = 0; sizeIndex < sizes.size(); ++sizeIndex)
+            {
+                for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+                {
+                    const ConvergenceStats& stats = convergence[(makeIndex * TestFns.size() + testIndex) * sizes.size() + sizeIndex];
+                    for (size_t stepIndex = 0; stepIndex < stats.steps.size(); ++stepIndex)
+                    {
+                        const ConvergenceStats::Step& step = stats.steps[stepIndex];
+                        csv.Cell(MakeFns[makeIndex].name);
+                        csv.Cell(sizes[sizeIndex]);
+                        csv.Cell(TestFns[testIndex].name);
+                        csv.Cell(stepIndex);
+                        csv.Cell(step.count);
+                        csv.Cell(step.window / double(step.count));
+                        csv.Cell(step.shrink / double(step.count));
+                        csv.EndRow();
+                    }
+                }
+            }
+        }
+        csv.Close();
+    }
+}
+
+// Finds the hybrid search parameters that search the fastest, for each number sequence. Every combination is timed on a
+// list of the biggest size with a sample of searches. The winner is verified, and timed against the defaults on a second
+// sample, since the fastest of many timings on the first one is flattered by the noise it was picked for.
+std::vector<HybridTuning> RunTuning(const Options& options, uint64_t tuneSeed)
+{
+    static const size_t c_lineFitSteps[] = { 1, 2, 3, 4 };
+    static const size_t c_linearFinishThresholds[] = { 0, 4, 8, 16, 32 };
+    static const size_t c_guardWidths[] = { 0, 1, 2, 4, 8 };
+
+    const std::vector<MakeListInfo>& MakeFns = options.makeFns;
+    size_t numValues = options.sizes.empty() ? c_maxNumValues : options.sizes.back();
+
+    RNG rng(tuneSeed);
+    std::vector<size_t> searchValues(c_tuneNumSearches);
+    for (size_t & v : searchValues)
+        v = rng.Range(0, c_maxValue);
+    std::vector<size_t> checkValues(c_tuneNumSearches);
+    for (size_t & v : checkValues)
+        v = rng.Range(0, c_maxValue);
+
+    ScopedThreadPin pin;
+    if (!pin.Pinned())
+        printf("Could not pin the tuner to a CPU, timings may be noisier\n");
+    printf("Tuning the hybrid search with %zu values and %zu searches\n", numValues, searchValues.size());
+
+    std::vector<HybridTuning> tunings;
+    for (const MakeListInfo& makeFn : MakeFns)
+    {
+        std::vector<size_t> values;
+        RNG makeRng(DeriveSeed(DeriveSeed(tuneSeed, HashName(makeFn.name)), numValues));
+        makeFn.fn(values, numValues, makeRng);
+
+        // a warmup pass, then the defaults to beat
+        const lfs::HybridIndex<size_t> defaultIndex((lfs::Span<size_t>(values)));
+        TimeHybridSearches(defaultIndex, searchValues, 1);
+        double bestSeconds = TimeHybridSearches(defaultIndex, searchValues, c_tuneTimedRuns);
+
+        HybridParams best;
+        for (size_t lineFitSteps : c_lineFitSteps)
+        {
+            for (size_t linearFinishThreshold : c_linearFinishThresholds)
+            {
+                for (size_t guardWidth : c_guardWidths)
+                {
+                    HybridParams params;
+                    params.lineFitSteps = lineFitSteps;
+                    params.linearFinishThreshold = linearFinishThreshold;
+                    params.guardWidth = guardWidth;
+                    double seconds = TimeHybridSearches(lfs::HybridIndex<size_t>(lfs::Span<size_t>(values), params), searchValues, c_tuneTimedRuns);
+                    if (seconds < bestSeconds)
+                    {
+                        best = params;
+                        bestSeconds = seconds;
+                    }
+                }
+            }
+        }
+
+        // check every search of the winner on the second sample, and count its guesses
+        const lfs::HybridIndex<size_t> bestIndex(lfs::Span<size_t>(values), best);
+        bool verified = true;
+        size_t guesses = 0;
+        for (size_t searchValue : checkValues)
+        {
+            TestResults result = bestIndex.Search<SearchPolicy_Count>(searchValue);
+            guesses += result.guesses;
+            if (!VerifyResults(values, searchValue, result, makeFn.name, "Hybrid"))
+                verified = false;
+        }
+
+        if (!verified)
+        {
+            printf("  %s : the tuned parameters failed verification, keeping the defaults\n", makeFn.name);
+            best = c_hybridDefaultParams;
+        }
+
+        double defaultSeconds = TimeHybridSearches(defaultIndex, checkValues, c_tuneTimedRuns);
+        double tunedSeconds = TimeHybridSearches(lfs::HybridIndex<size_t>(lfs::Span<size_t>(values), best), checkValues, c_tuneTimedRuns);
+        printf("  %s : %zu line fit steps per binary search step, linear finish at %zu, guard width %zu. %f seconds vs %f with the defaults (%.2fx) on other searches, %f guesses per search\n",
+            makeFn.name, best.lineFitSteps, best.linearFinishThreshold, best.guardWidth, tunedSeconds, defaultSeconds, defaultSeconds / tunedSeconds,
+            double(guesses) / double(checkValues.size()));
+        tunings.push_back({ NormalizeName(makeFn.name), best });
+    }
+
+    if (SaveHybridTunings("out/HybridTuning.txt", tunings))
+        printf("Wrote out/HybridTuning.txt\n");
+    printf("\n");
+    return tunings;
+}
+
+void RunPerfTest(const Options& options, uint64_t perfSeed)
+{
+    const std::vector<MakeListInfo>& MakeFns = options.makeFns;
+    const std::vector<TestListInfo>& TestFns = options.testFns;
+
+    std::vector<size_t> sizes = options.sizes;
+    if (sizes.empty())
+        sizes.push_back(c_maxNumValues);
+
+    RNG rng(perfSeed);
+
+    std::vector<size_t> searchValues;
+    searchValues.resize(c_perfTestNumSearches);
+
+    // make the search values that are going to be used by all the tests
+    for (size_t & v : searchValues)
+        v = rng.Range(0, c_maxValue);
+
+    const bool verify = options.verifySampler.Enabled();
+    AsyncVerifier verifier;
+
+    // keep the timing on one core so the time stamp counter and the caches stay the same between passes
+    ScopedThreadPin pin;
+    if (!pin.Pinned())
+        printf("Could not pin the perf test to a CPU, timings may be noisier\n");
+    printf("Timer: %s at %f GHz\n", CycleTimer::Name(), CycleTimer::TicksPerSecond() / 1000000000.0);
+
+    EnergyMeter energyMeter;
+    bool energy = options.energy && energyMeter.Open();
+    if (options.energy && !energy)
+        printf("Could not read the RAPL energy counters in /sys/class/powercap (they may need root), so energy won't be reported\n");
+    const size_t numEnergyDomains = energy ? energyMeter.Domains().size() : 0;
+
+    // build time, memory and lookup time of every engine on every list, for the Pareto report
+    CSVWriter paretoCSV;
+    if (paretoCSV.Open("out/Pareto.csv"))
+    {
+        paretoCSV.Cell("Dataset");
+        paretoCSV.Cell("Sample Count");
+        paretoCSV.Cell("Engine");
+        paretoCSV.Cell("Build ns");
+        paretoCSV.Cell("Bytes Per Key");
+        paretoCSV.Cell("Lookup ns");
+        paretoCSV.Cell("Pareto Front");
+        paretoCSV.EndRow();
+    }
+
+    // every timed pass of every engine on every list, for comparing runs with --compare
+    CSVWriter runsCSV;
+    if (runsCSV.Open("out/Perf.csv"))
+    {
+        runsCSV.Cell("Dataset");
+        runsCSV.Cell("Sample Count");
+        runsCSV.Cell("Engine");
+        runsCSV.Cell("Run");
+        runsCSV.Cell("ns Per Search");
+        runsCSV.EndRow();
+    }
+
+    for (size_t numValues : sizes)
+    {
+        std::vector<ParetoPoint> paretoPoints;
+        if (sizes.size() > 1)
+            printf("Perf test with %zu values\n", numValues);
+
+        // Make every list up front. Every search function sees the same list for a given number sequence, and the lists
+        // stay alive while the verifier checks results against them.
+        std::vector<std::vector<size_t>> lists(MakeFns.size());
+        for (size_t makeIndex = 0; makeIndex < MakeFns.size(); ++makeIndex)
+        {
+            RNG makeRng(DeriveSeed(DeriveSeed(perfSeed, HashName(MakeFns[makeIndex].name)), numValues));
+            MakeFns[makeIndex].fn(lists[makeIndex], numValues, makeRng);
+        }
+
+        // binary search, linear search, etc
+        for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+        {
+            // quadratic numbers, random numbers, etc
+            double timeTotal = 0.0f;
+            size_t totalGuesses = 0;
+            std::vector<uint64_t> energyTotal(numEnergyDomains, 0);
+            for (size_t makeIndex = 0; makeIndex < MakeFns.size(); ++makeIndex)
+            {
+                const std::vector<size_t>& values = lists[makeIndex];
+
+                // Engines with an index build it first. Builds are timed like the searches, and the median is reported.
+                std::unique_ptr<SearchIndex> index;
+                double buildSeconds = 0.0;
+                if (TestFns[testIndex].build)
+                {
+                    // the verifier thread would share the CPU and caches with the builds
+                    if (verify)
+                        verifier.Wait();
+
+                    uint64_t buildTicks[c_perfTestTimedRuns];
+                    for (uint64_t& ticks : buildTicks)
+                    {
+                        index.reset();
+                        uint64_t start = CycleTimer::Now();
+                        index = TestFns[testIndex].build(values);
+                        ticks = CycleTimer::Now() - start;
+                    }
+                    std::sort(buildTicks, buildTicks + c_perfTestTimedRuns);
+                    buildSeconds = CycleTimer::Seconds(buildTicks[c_perfTestTimedRuns / 2]);
+                }
+                t_searchIndex = index.get();
+
+                // The counting pass counts the guesses and stores the sampled results for the verifier thread. The timed
+                // passes, and the warmup passes that bring the list and code into the caches before them, use the
+                // production build of the search function, which does nothing but search.
+                AsyncVerifier::Batch verifyBatch;
+                verifyBatch.values = &values;
+                verifyBatch.list = MakeFns[makeIndex].name;
+                verifyBatch.test = TestFns[testIndex].name;
+                if (verify)
+                    verifyBatch.queries.reserve(searchValues.size());
+
+                for (size_t searchIndex = 0; searchIndex < searchValues.size(); ++searchIndex)
+                {
+                    size_t searchValue = searchValues[searchIndex];
+                    TestResults ret = TestFns[testIndex].fn(values, searchValue);
+                    totalGuesses += ret.guesses;
+
+                    if (verify && options.verifySampler.Sample(searchIndex))
+                        verifyBatch.queries.push_back({ searchValue, ret });
+                }
+
+                if (verify)
+                    verifier.Submit(std::move(verifyBatch));
+
+                for (size_t warmupIndex = 0; warmupIndex < c_perfTestWarmupRuns; ++warmupIndex)
+                    TestFns[testIndex].productionPass(values, searchValues.data(), searchValues.size());
+
+                // The verifier checks this batch while the warmup passes run, and is done before the timed passes and
+                // the energy they're measured with, so neither includes its work.
+                if (verify)
+                    verifier.Wait();
+
+                // the timed passes. The median is reported, so one pass that gets interrupted doesn't skew the results.
+                uint64_t runTicks[c_perfTestTimedRuns];
+                std::vector<uint64_t> energyBefore = energy ? energyMeter.Read() : std::vector<uint64_t>();
+                for (uint64_t& ticks : runTicks)
+                {
+                    ClobberMemory();
+                    uint64_t start = CycleTimer::Now();
+
+                    TestFns[testIndex].productionPass(values, searchValues.data(), searchValues.size());
+
+                    ClobberMemory();
+                    ticks = CycleTimer::Now() - start;
+                }
+                std::vector<uint64_t> energyAfter = energy ? energyMeter.Read() : std::vector<uint64_t>();
+                for (size_t runIndex = 0; runIndex < c_perfTestTimedRuns && runsCSV.file; ++runIndex)
+                {
+                    runsCSV.Cell(MakeFns[makeIndex].name);
+                    runsCSV.Cell(numValues);
+                    runsCSV.Cell(TestFns[testIndex].name);
+                    runsCSV.Cell(runIndex);
+                    runsCSV.Cell(CycleTimer::Seconds(runTicks[runIndex]) * 1000000000.0 / double(searchValues.size()));
+                    runsCSV.EndRow();
+                }
+                std::sort(runTicks, runTicks + c_perfTestTimedRuns);
+                double seconds = CycleTimer::Seconds(runTicks[c_perfTestTimedRuns / 2]);
+                t_searchIndex = nullptr;
+
+                double bytesPerKey = index ? double(index->Bytes()) / double(values.size()) : 0.0;
+                paretoPoints.push_back({ MakeFns[makeIndex].name, numValues, TestFns[testIndex].name, buildSeconds, bytesPerKey, seconds * 1000000000.0 / double(searchValues.size()) });
+
+                timeTotal += seconds;
+                printf("  %s %s : %f seconds", TestFns[testIndex].name, MakeFns[makeIndex].name, seconds);
+                if (index)
+                    printf("  (built in %f seconds, %f bytes per key)", buildSeconds, bytesPerKey);
+
+                // energy is over all of the timed passes
+                for (size_t domainIndex = 0; domainIndex < numEnergyDomains; ++domainIndex)
+                {
+                    uint64_t used = energyMeter.Used(domainIndex, energyBefore[domainIndex], energyAfter[domainIndex]);
+                    energyTotal[domainIndex] += used;
+                    double nanojoulesPerSearch = double(used) * 1000.0 / double(c_perfTestTimedRuns * searchValues.size());
+                    printf("  %s %f nJ", energyMeter.Domains()[domainIndex].name.c_str(), nanojoulesPerSearch);
+                }
+                printf(numEnergyDomains ? " per search\n" : "\n");
+            }
+
+            double timePerGuess = (timeTotal * 1000.0 * 1000.0 * 1000.0f) / double(totalGuesses);
+            printf("%s total : %f seconds  (%zu guesses = %f nanoseconds per guess)\n", TestFns[testIndex].name, timeTotal, totalGuesses, timePerGuess);
+            for (size_t domainIndex = 0; domainIndex < numEnergyDomains; ++domainIndex)
+            {
+                double nanojoulesPerSearch = double(energyTotal[domainIndex]) * 1000.0 / double(MakeFns.size() * c_perfTestTimedRuns * searchValues.size());
+                printf("  %s : %f nanojoules per search\n", energyMeter.Domains()[domainIndex].name.c_str(), nanojoulesPerSearch);
+            }
+            printf("\n");
+        }
+
+        // the tuned hybrid search against the default alternation, on the same lists and searches
+        if (!options.hybridTunings.empty())
+        {
+            for (size_t makeIndex = 0; makeIndex < MakeFns.size(); ++makeIndex)
+            {
+                const HybridParams* tuned = FindHybridTuning(options.hybridTunings, MakeFns[makeIndex].name);
+                if (!tuned)
+                    continue;
+
+                const lfs::HybridIndex<size_t> defaultIndex((lfs::Span<size_t>(lists[makeIndex])));
+                const lfs::HybridIndex<size_t> tunedIndex(lfs::Span<size_t>(lists[makeIndex]), *tuned);
+                TimeHybridSearches(defaultIndex, searchValues, 1);
+                double defaultSeconds = TimeHybridSearches(defaultIndex, searchValues, c_perfTestTimedRuns);
+                double tunedSeconds = TimeHybridSearches(tunedIndex, searchValues, c_perfTestTimedRuns);
+                printf("  Hybrid Tuned %s : %f seconds vs %f seconds with the defaults, %.2fx speedup\n", MakeFns[makeIndex].name, tunedSeconds, defaultSeconds, defaultSeconds / tunedSeconds);
+            }
+            printf("\n");
+        }
+
+        ReportParetoFront(paretoPoints, paretoCSV);
+
+        // the lists are about to go away, so everything that points at them has to be verified first
+        verifier.Wait();
+    }
+
+    paretoCSV.Close();
+    runsCSV.Close();
+
+    if (verify)
+        printf("Perf test verification failures: %zu\n", verifier.Finish());
+}
+
+// Searches from many threads at once against one shared list, to see how each search function scales when the
+// threads compete for caches and memory bandwidth.
+void RunThroughputTest(const Options& options, uint64_t throughputSeed)
+{
+    const std::vector<MakeListInfo>& MakeFns = options.makeFns;
+    const std::vector<TestListInfo>& TestFns = options.testFns;
+
+    std::vector<size_t> sizes = options.sizes;
+    if (sizes.empty())
+        sizes.push_back(c_maxNumValues);
+
+    const size_t numThreads = options.NumThreads();
+
+    RNG rng(throughputSeed);
+    std::vector<size_t> searchValues;
+    searchValues.resize(c_perfTestNumSearches);
+    for (size_t & v : searchValues)
+        v = rng.Range(0, c_maxValue);
+
+    printf("Throughput test with %zu threads\n", numThreads);
+    for (size_t numValues : sizes)
+    {
+        for (size_t makeIndex = 0; makeIndex < MakeFns.size(); ++makeIndex)
+        {
+            std::vector<size_t> values;
+            RNG makeRng(DeriveSeed(DeriveSeed(throughputSeed, HashName(MakeFns[makeIndex].name)), numValues));
+            MakeFns[makeIndex].fn(values, numValues, makeRng);
+
+            for (size_t testIndex = 0; testIndex < TestFns.size(); ++testIndex)
+            {
+                // the threads share one index, for the engines that have one
+                std::unique_ptr<SearchIndex> index;
+                if (TestFns[testIndex].build)
+                    index = TestFns[testIndex].build(values);
+
+                // every thread does all of the searches, so the guesses are counted once up front, and the threads run
+                // the production build of the search function
+                size_t totalGuesses = 0;
+                t_searchIndex = index.get();
+                for (size_t searchValue : searchValues)
+                    totalGuesses += TestFns[testIndex].fn(values, searchValue).guesses;
+                t_searchIndex = nullptr;
+                totalGuesses *= numThreads;
+
+                // each thread starts at a different place in the list of search values
+                std::atomic<bool> go(false);
+                std::vector<std::thread> threads(numThreads);
+                for (size_t threadIndex = 0; threadIndex < numThreads; ++threadIndex)
+                {
+                    threads[threadIndex] = std::thread(
+                        [&, threadIndex]()
+                        {
+                            while (!go)
+                                std::this_thread::yield();
+
+                            t_searchIndex = index.get();
+
+                            size_t firstSearch = (threadIndex * searchValues.size()) / numThreads;
+                            TestFns[testIndex].productionPass(values, searchValues.data() + firstSearch, searchValues.size() - firstSearch);
+                            TestFns[testIndex].productionPass(values, searchValues.data(), firstSearch);
+                        }
+                    );
+                }
+
+                std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                go = true;
+                for (std::thread& t : threads)
+                    t.join();
+                std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+                double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(end - start).count();
+                double searchesPerSecond = double(searchValues.size() * numThreads) / seconds;
+                printf("  %s %s (%zu values) : %f million searches per second  (%zu guesses)\n", TestFns[testIndex].name, MakeFns[makeIndex].name, numValues, searchesPerSecond / 1000000.0, totalGuesses);
+            }
+        }
+    }
+    printf("\n");
+}
+
+// the list sizes the fixed size test compiles searches for
+template <size_t... Sizes>
+struct FixedSizeList
+{
+};
+
+using FixedSizes = FixedSizeList<8, 16, 32, 64, 128, 256, 512, 1024>;
+
+// how a fixed size search did against the search function that doesn't know the list size
+struct FixedSizeResult
+{
+    double runtimeSeconds = 0.0;
+    double fixedSeconds = 0.0;
+    size_t runtimeGuesses = 0;
+    size_t fixedGuesses = 0;
+    size_t mismatches = 0;
+};
+
+FixedSizeResult TimeFixedSize(TestListFn runtimeCount, TestListFn fixedCount, SearchPassFn runtimePass, SearchPassFn fixedPass, const std::vector<size_t>& values, const std::vector<size_t>& searchValues)
+{
+    FixedSizeResult ret;
+
+    // the counting builds count the guesses, and the fixed size search has to find the same values
+    for (size_t searchValue : searchValues)
+    {
+        TestResults runtimeResult = runtimeCount(values, searchValue);
+        TestResults fixedResult = fixedCount(values, searchValue);
+        ret.runtimeGuesses += runtimeResult.guesses;
+        ret.fixedGuesses += fixedResult.guesses;
+        if (runtimeResult.found != fixedResult.found || (fixedResult.found && values[fixedResult.index] != searchValue))
+            ret.mismatches++;
+    }
+
+    for (size_t warmupIndex = 0; warmupIndex < c_perfTestWarmupRuns; ++warmupIndex)
+    {
+        runtimePass(values, searchValues.data(), searchValues.size());
+        fixedPass(values, searchValues.data(), searchValues.size());
+    }
+    ret.runtimeSeconds = TimeSearches(runtimePass, values, searchValues, c_perfTestTimedRuns);
+    ret.fixedSeconds = TimeSearches(fixedPass, values, searchValues, c_perfTestTimedRuns);
+    return ret;
+}
+
+template <size_t N>
+void RunFixedSize(const Options& options, uint64_t fixedSeed, const std::vector<size_t>& searchValues, CSVWriter& csv, size_t& mismatches)
+{
+    // --sizes picks from the compiled sizes
+    if (!options.sizes.empty() && std::find(options.sizes.begin(), options.sizes.end(), N) == options.sizes.end())
+        return;
+
+    struct Engine
+    {
+        const char* name;
+        TestListFn runtimeCount;
+        TestListFn fixedCount;
+        SearchPassFn runtimePass;
+        SearchPassFn fixedPass;
+    };
+
+    static const Engine c_engines[] =
+    {
+        {
+            "Binary Search",
+            TestList_BinarySearch<SearchPolicy_Count>, TestList_FixedBinarySearch<N, SearchPolicy_Count>,
+            SearchPass<TestList_BinarySearch<SearchPolicy_None>>, SearchPass<TestList_FixedBinarySearch<N, SearchPolicy_None>>
+        },
+        {
+            "Line Fit",
+            TestList_LineFitThenBinary<SearchPolicy_Count>, TestList_FixedLineFit<N, SearchPolicy_Count>,
+            SearchPass<TestList_LineFitThenBinary<SearchPolicy_None>>, SearchPass<TestList_FixedLineFit<N, SearchPolicy_None>>
+        },
+    };
+
+    printf("Fixed size test with %zu values\n", N);
+    for (const Engine& engine : c_engines)
+    {
+        double runtimeTotal = 0.0;
+        double fixedTotal = 0.0;
+        for (const MakeListInfo& makeInfo : options.makeFns)
+        {
+            std::vector<size_t> values;
+            RNG makeRng(DeriveSeed(DeriveSeed(fixedSeed, HashName(makeInfo.name)), N));
+            makeInfo.fn(values, N, makeRng);
+
+            FixedSizeResult result = TimeFixedSize(engine.runtimeCount, engine.fixedCount, engine.runtimePass, engine.fixedPass, values, searchValues);
+            runtimeTotal += result.runtimeSeconds;
+            fixedTotal += result.fixedSeconds;
+            mismatches += result.mismatches;
+
+            double runtimeNs = result.runtimeSeconds * 1000000000.0 / double(searchValues.size());
+            double fixedNs = result.fixedSeconds * 1000000000.0 / double(searchValues.size());
+            double runtimeGuesses = double(result.runtimeGuesses) / double(searchValues.size());
+            double fixedGuesses = double(result.fixedGuesses) / double(searchValues.size());
+            printf("  %s %s : %f ns vs %f ns per search, %.2fx speedup  (%.2f vs %.2f guesses)\n", engine.name, makeInfo.name, fixedNs, runtimeNs, runtimeNs / fixedNs, fixedGuesses, runtimeGuesses);
+
+            if (csv.file)
+            {
+                csv.Cell(makeInfo.name);
+                csv.Cell(N);
+                csv.Cell(engine.name);
+                csv.Cell(runtimeNs);
+                csv.Cell(fixedNs);
+                csv.Cell(runtimeGuesses);
+                csv.Cell(fixedGuesses);
+                csv.EndRow();
+            }
+        }
+        printf("%s total : %f seconds vs %f seconds, %.2fx speedup\n", engine.name, fixedTotal, runtimeTotal, runtimeTotal / fixedTotal);
+    }
+    printf("\n");
+}
+
+template <size_t... Sizes>
+void RunFixedSizes(const Options& options, uint64_t fixedSeed, const std::vector<size_t>& searchValues, CSVWriter& csv, size_t& mismatches, FixedSizeList<Sizes...>)
+{
+    for (size_t size : options.sizes)
+    {
+        if (((size != Sizes) && ...))
+            printf("No fixed size searches are compiled for %zu values, so it's skipped. The sizes are%s\n", size, ((" " + std::to_string(Sizes)) + ...).c_str());
+    }
+
+    (RunFixedSize<Sizes>(options, fixedSeed, searchValues, csv, mismatches), ...);
+}
+
+// Times the searches that know the list size at compile time against the search functions that don't, on small lists
+// like the blocks of keys in the nodes of a tree.
+void RunFixedSizeTest(const Options& options, uint64_t fixedSeed)
+{
+    RNG rng(fixedSeed);
+    std::vector<size_t> searchValues;
+    searchValues.resize(c_perfTestNumSearches);
+    for (size_t & v : searchValues)
+        v = rng.Range(0, c_maxValue);
+
+    ScopedThreadPin pin;
+    if (!pin.Pinned())
+        printf("Could not pin the fixed size test to a CPU, timings may be noisier\n");
+
+    CSVWriter csv;
+    if (csv.Open("out/FixedSize.csv"))
+    {
+        csv.Cell("Dataset");
+        csv.Cell("Sample Count");
+        csv.Cell("Engine");
+        csv.Cell("Runtime Size ns");
+        csv.Cell("Fixed Size ns");
+        csv.Cell("Runtime Size Guesses");
+        csv.Cell("Fixed Size Guesses");
+        csv.EndRow();
+    }
+
+    size_t mismatches = 0;
+    RunFixedSizes(options, fixedSeed, searchValues, csv, mismatches, FixedSizes());
+    csv.Close();
+
+    printf("Fixed size test mismatches: %zu\n\n", mismatches);
+}
+
+// A flat map that finds keys with std::lower_bound, to time lfs::FlatMap against
+struct LowerBoundFlatMap
+{
+    std::vector<size_t> keys;
+    std::vector<size_t> values;
+
+    void insert(const std::pair<size_t, size_t>& keyValue)
+    {
+        std::vector<size_t>::iterator it = std::lower_bound(keys.begin(), keys.end(), keyValue.first);
+        if (it != keys.end() && *it == keyValue.first)
+            return;
+        values.insert(values.begin() + (it - keys.begin()), keyValue.second);
+        keys.insert(it, keyValue.first);
+    }
+
+    const size_t* find(size_t key) const
+    {
+        std::vector<size_t>::const_iterator it = std::lower_bound(keys.begin(), keys.end(), key);
+        return (it != keys.end() && *it == key) ? &values[it - keys.begin()] : end();
+    }
+
+    const size_t* end() const
+    {
+        return values.data() + values.size();
+    }
+};
+
+struct ContainerResult
+{
+    double insertSeconds = 0.0;
+    double findSeconds = 0.0;
+    size_t found = 0;
+};
+
+// Times filling a container with the keys, in the order given, and then finding the search values in it. Both are timed
+// c_perfTestTimedRuns times and the medians are reported.
+template <typename TContainer>
+ContainerResult TimeContainer(const std::vector<size_t>& keys, const std::vector<size_t>& searchValues)
+{
+    ContainerResult ret;
+    uint64_t insertTicks[c_perfTestTimedRuns];
+    uint64_t findTicks[c_perfTestTimedRuns];
+    for (size_t runIndex = 0; runIndex < c_perfTestTimedRuns; ++runIndex)
+    {
+        TContainer container;
+
+        ClobberMemory();
+        uint64_t start = CycleTimer::Now();
+        for (size_t keyIndex = 0; keyIndex < keys.size(); ++keyIndex)
+            container.insert(std::make_pair(keys[keyIndex], keyIndex));
+        ClobberMemory();
+        insertTicks[runIndex] = CycleTimer::Now() - start;
+
+        size_t found = 0;
+        start = CycleTimer::Now();
+        for (size_t searchValue : searchValues)
+            found += container.find(searchValue) != container.end() ? 1 : 0;
+        DoNotOptimize(found);
+        ClobberMemory();
+        findTicks[runIndex] = CycleTimer::Now() - start;
+        ret.found = found;
+    }
+
+    std::sort(insertTicks, insertTicks + c_perfTestTimedRuns);
+    std::sort(findTicks, findTicks + c_perfTestTimedRuns);
+    ret.insertSeconds = CycleTimer::Seconds(insertTicks[c_perfTestTimedRuns / 2]);
+    ret.findSeconds = CycleTimer::Seconds(findTicks[c_perfTestTimedRuns / 2]);
+    return ret;
+}
+
+// Runs the keys and the search values through lfs::FlatMap and lfs::FlatSet and through std::map and std::set, and
+// counts the results that differ: inserts, lower_bound, operator[], erases, and what iterating over them gives after.
+// Looks up keys at and outside the ends of the ones in the containers, where the line says a position far past them,
+// and compares them to std::map. Returns how many are wrong.
+template <typename Key>
+size_t CheckFlatContainersOutside(const std::vector<size_t>& keys, const Key* outsideKeys, size_t numOutsideKeys)
+{
+    lfs::FlatMap<Key, size_t> flatMap;
+    std::map<Key, size_t> stdMap;
+    for (size_t keyIndex = 0; keyIndex < keys.size(); ++keyIndex)
+    {
+        flatMap.insert(Key(keys[keyIndex]), keyIndex);
+        stdMap.insert(std::make_pair(Key(keys[keyIndex]), keyIndex));
+    }
+
+    size_t mismatches = 0;
+    for (size_t index = 0; index < numOutsideKeys; ++index)
+    {
+        const Key& key = outsideKeys[index];
+        size_t flatIndex = size_t(std::distance(flatMap.begin(), flatMap.lower_bound(key)));
+        size_t stdIndex = size_t(std::distance(stdMap.begin(), stdMap.lower_bound(key)));
+        mismatches += flatIndex != stdIndex || flatMap.count(key) != stdMap.count(key) ? 1 : 0;
+    }
+    return mismatches;
+}
+
+size_t CheckFlatContainers(const std::vector<size_t>& keys, const std::vector<size_t>& searchValues)
+{
+    static const size_t c_outsideKeys[] = { 0, size_t(c_maxValue) * 1000, SIZE_MAX / 2, SIZE_MAX - 1, SIZE_MAX };
+    static const double c_outsideDoubleKeys[] = { -1e30, -1.0, 1e30, 1e300, -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() };
+    size_t mismatches = CheckFlatContainersOutside(keys, c_outsideKeys, countof(c_outsideKeys));
+    mismatches += CheckFlatContainersOutside(keys, c_outsideDoubleKeys, countof(c_outsideDoubleKeys));
+
+    lfs::FlatMap<size_t, size_t> flatMap;
+    lfs::FlatSet<size_t> flatSet;
+    std::map<size_t, size_t> stdMap;
+    std::set<size_t> stdSet;
+    for (size_t keyIndex = 0; keyIndex < keys.size(); ++keyIndex)
+    {
+        mismatches += flatMap.insert(keys[keyIndex], keyIndex).second != stdMap.insert(std::make_pair(keys[keyIndex], keyIndex)).second ? 1 : 0;
+        mismatches += flatSet.insert(keys[keyIndex]).second != stdSet.insert(keys[keyIndex]).second ? 1 : 0;
+    }
+
+    // erasing and operator[] move the keys after them, so the checks only use as many search values as there are keys
+    size_t numChecks = std::min(searchValues.size(), keys.size() * 2);
+    for (size_t checkIndex = 0; checkIndex < numChecks; ++checkIndex)
+    {
+        size_t searchValue = searchValues[checkIndex];
+
+        lfs::FlatMap<size_t, size_t>::const_iterator flatMapIt = flatMap.lower_bound(searchValue);
+        std::map<size_t, size_t>::const_iterator stdMapIt = stdMap.lower_bound(searchValue);
+        if ((flatMapIt == flatMap.end()) != (stdMapIt == stdMap.end()) || (stdMapIt != stdMap.end() && (flatMapIt->first != stdMapIt->first || flatMapIt->second != stdMapIt->second)))
+            mismatches++;
+
+        lfs::FlatSet<size_t>::const_iterator flatSetIt = flatSet.lower_bound(searchValue);
+        std::set<size_t>::const_iterator stdSetIt = stdSet.lower_bound(searchValue);
+        if ((flatSetIt == flatSet.end()) != (stdSetIt == stdSet.end()) || (stdSetIt != stdSet.end() && *flatSetIt != *stdSetIt))
+            mismatches++;
+        mismatches += flatSet.count(searchValue) != stdSet.count(searchValue) ? 1 : 0;
+
+        // half of the search values are erased, and the other half are added or bumped
+        if (checkIndex % 2)
+        {
+            mismatches += flatMap.erase(searchValue) != stdMap.erase(searchValue) ? 1 : 0;
+            mismatches += flatSet.erase(searchValue) != stdSet.erase(searchValue) ? 1 : 0;
+        }
+        else
+        {
+            mismatches += ++flatMap[searchValue] != ++stdMap[searchValue] ? 1 : 0;
+            mismatches += flatSet.insert(searchValue).second != stdSet.insert(searchValue).second ? 1 : 0;
+        }
+    }
+
+    mismatches += flatMap.size() != stdMap.size() || flatSet.size() != stdSet.size() ? 1 : 0;
+    if (flatMap.size() == stdMap.size() && !std::equal(flatMap.begin(), flatMap.end(), stdMap.begin(),
+        [](const std::pair<const size_t&, const size_t&>& a, const std::pair<const size_t, size_t>& b) { return a.first == b.first && a.second == b.second; }))
+        mismatches++;
+    if (flatSet.size() == stdSet.size() && !std::equal(flatSet.begin(), flatSet.end(), stdSet.begin()))
+        mismatches++;
+    return mismatches;
+}
+
+// Times lfs::FlatMap, which finds keys with a line fit to them, against std::map and a flat map that uses
+// std::lower_bound. The keys are the number sequences, inserted in a random order.
+void RunContainerTest(const Options& options, uint64_t containerSeed)
+{
+    std::vector<size_t> sizes = options.sizes;
+    if (sizes.empty())
+        sizes.push_back(c_maxNumValues);
+
+    RNG rng(containerSeed);
+    std::vector<size_t> searchValues;
+    searchValues.resize(c_perfTestNumSearches);
+    for (size_t & v : searchValues)
+        v = rng.Range(0, c_maxValue);
+
+    ScopedThreadPin pin;
+    if (!pin.Pinned())
+        printf("Could not pin the container test to a CPU, timings may be noisier\n");
+
+    CSVWriter csv;
+    if (csv.Open("out/Container.csv"))
+    {
+        csv.Cell("Dataset");
+        csv.Cell("Sample Count");
+        csv.Cell("Container");
+        csv.Cell("Insert ns");
+        csv.Cell("Find ns");
+        csv.EndRow();
+    }
+
+    struct Container
+    {
+        const char* name;
+        ContainerResult(*time)(const std::vector<size_t>& keys, const std::vector<size_t>& searchValues);
+    };
+
+    static const Container c_containers[] =
+    {
+        { "std::map", TimeContainer<std::map<size_t, size_t>> },
+        { "Flat Map", TimeContainer<LowerBoundFlatMap> },
+        { "lfs::FlatMap", TimeContainer<lfs::FlatMap<size_t, size_t>> },
+    };
+
+    size_t mismatches = 0;
+    for (size_t numValues : sizes)
+    {
+        printf("Container test with %zu values\n", numValues);
+        for (const MakeListInfo& makeInfo : options.makeFns)
+        {
+            std::vector<size_t> keys;
+            RNG makeRng(DeriveSeed(DeriveSeed(containerSeed, HashName(makeInfo.name)), numValues));
+            makeInfo.fn(keys, numValues, makeRng);
+
+            // the lists come out sorted, which would make every insert an append
+            for (size_t index = keys.size(); index > 1; --index)
+                std::swap(keys[index - 1], keys[makeRng.Range(0, index - 1)]);
+
+            mismatches += CheckFlatContainers(keys, searchValues);
+
+            size_t expectedFound = 0;
+            for (size_t containerIndex = 0; containerIndex < countof(c_containers); ++containerIndex)
+            {
+                const Container& container = c_containers[containerIndex];
+                ContainerResult result = container.time(keys, searchValues);
+
+                // every container has to find the same keys
+                if (containerIndex == 0)
+                    expectedFound = result.found;
+                else if (result.found != expectedFound)
+                    mismatches++;
+
+                double insertNs = result.insertSeconds * 1000000000.0 / double(keys.size());
+                double findNs = result.findSeconds * 1000000000.0 / double(searchValues.size());
+                printf("  %s %s : %f ns per find, %f ns per insert\n", container.name, makeInfo.name, findNs, insertNs);
+
+                if (csv.file)
+                {
+                    csv.Cell(makeInfo.name);
+                    csv.Cell(numValues);
+                    csv.Cell(container.name);
+                    csv.Cell(insertNs);
+                    csv.Cell(findNs);
+                    csv.EndRow();
+                }
+            }
+        }
+        printf("\n");
+    }
+    csv.Close();
+
+    printf("Container test mismatches: %zu\n\n", mismatches);
+}
+
+// A B+ tree with one level of inner node: sorted leaves of up to c_blockIndexLeafKeys keys, and the smallest key of
+// each leaf. A full leaf splits in two.
+struct BlockIndex
+{
+    struct Leaf
+    {
+        std::vector<size_t> keys;
+        std::vector<size_t> values;
+    };
+
+    std::vector<size_t> pivots;
+    std::vector<Leaf> leaves;
+
+    // bulk loads sorted, unique keys, filling the leaves half way like the gapped index's nodes
+    BlockIndex(lfs::Span<size_t> keys, lfs::Span<size_t> values)
+    {
+        for (size_t first = 0; first < keys.size(); first += c_blockIndexLeafKeys / 2)
+        {
+            size_t count = std::min(c_blockIndexLeafKeys / 2, keys.size() - first);
+            pivots.push_back(keys[first]);
+            leaves.push_back({ std::vector<size_t>(keys.begin() + first, keys.begin() + first + count), std::vector<size_t>(values.begin() + first, values.begin() + first + count) });
+        }
+    }
+
+    size_t LeafIndex(size_t key) const
+    {
+        size_t index = std::upper_bound(pivots.begin(), pivots.end(), key) - pivots.begin();
+        return index > 0 ? index - 1 : 0;
+    }
+
+    const size_t* Find(size_t key) const
+    {
+        if (leaves.empty())
+            return nullptr;
+        const Leaf& leaf = leaves[LeafIndex(key)];
+        std::vector<size_t>::const_iterator it = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+        return (it != leaf.keys.end() && *it == key) ? &leaf.values[it - leaf.keys.begin()] : nullptr;
+    }
+
+    bool Insert(size_t key, size_t value)
+    {
+        if (leaves.empty())
+        {
+            pivots.push_back(key);
+            leaves.push_back({ { key }, { value } });
+            return true;
+        }
+
+        size_t leafIndex = LeafIndex(key);
+        Leaf& leaf = leaves[leafIndex];
+        std::vector<size_t>::iterator it = std::lower_bound(leaf.keys.begin(), leaf.keys.end(), key);
+        if (it != leaf.keys.end() && *it == key)
+            return false;
+
+        if (leaf.keys.size() == c_blockIndexLeafKeys)
+        {
+            size_t half = c_blockIndexLeafKeys / 2;
+            Leaf right = { std::vector<size_t>(leaf.keys.begin() + half, leaf.keys.end()), std::vector<size_t>(leaf.values.begin() + half, leaf.values.end()) };
+            leaf.keys.resize(half);
+            leaf.values.resize(half);
+            pivots.insert(pivots.begin() + leafIndex + 1, right.keys[0]);
+            leaves.insert(leaves.begin() + leafIndex + 1, std::move(right));
+            return Insert(key, value);
+        }
+
+        leaf.values.insert(leaf.values.begin() + (it - leaf.keys.begin()), value);
+        leaf.keys.insert(it, key);
+        if (key < pivots[leafIndex])
+            pivots[leafIndex] = key;
+        return true;
+    }
+
+    size_t Bytes() const
+    {
+        size_t ret = pivots.capacity() * sizeof(size_t) + leaves.capacity() * sizeof(Leaf);
+        for (const Leaf& leaf : leaves)
+            ret += (leaf.keys.capacity() + leaf.values.capacity()) * sizeof(size_t);
+        return ret;
+    }
+};
+
+// lfs::LogStructuredIndex copies values out, since a merge can replace the run a value is in, so this keeps the last
+// one found for the update test to point at. The buffer is sized to the loaded keys, since the default buffer would
+// hold every insert of the smaller tests and never flush.
+struct LogStructuredIndexAdapter
+{
+    lfs::LogStructuredIndex<size_t, size_t> index;
+    size_t lastFound = 0;
+
+    LogStructuredIndexAdapter(lfs::Span<size_t> keys, lfs::Span<size_t> values) : index(keys, values, MakeParams(keys.size())) {}
+
+    static lfs::LogStructuredIndex<size_t, size_t>::Params MakeParams(size_t numKeys)
+    {
+        lfs::LogStructuredIndex<size_t, size_t>::Params params;
+        params.bufferKeys = std::max<size_t>(numKeys / c_updateTestBufferDivisor, 1);
+        return params;
+    }
+
+    void Insert(size_t key, size_t value)
+    {
+        index.Insert(key, value);
+    }
+
+    const size_t* Find(size_t key)
+    {
+        return index.Find(key, lastFound) ? &lastFound : nullptr;
+    }
+
+    // the merges a run of operations started are part of what it costs
+    void Finish()
+    {
+        index.WaitForMerges();
+    }
+
+    size_t Bytes() const
+    {
+        return index.Bytes();
+    }
+};
+
+// the other indices are done once the last operation returns
+template <typename TIndex>
+void FinishUpdates(TIndex&)
+{
+}
+
+void FinishUpdates(LogStructuredIndexAdapter& index)
+{
+    index.Finish();
+}
+
+struct UpdateOperation
+{
+    bool insert;
+    size_t key;
+};
+
+struct UpdateResult
+{
+    double seconds = 0.0;
+    size_t found = 0;
+    size_t bytes = 0;
+};
+
+// Bulk loads the index with the sorted keys, then times the operations and any work they left running in the
+// background. That's done c_perfTestTimedRuns times, and the median is reported.
+template <typename TIndex>
+UpdateResult TimeUpdates(const std::vector<size_t>& loadKeys, const std::vector<UpdateOperation>& operations)
+{
+    UpdateResult ret;
+    uint64_t runTicks[c_perfTestTimedRuns];
+    for (uint64_t& ticks : runTicks)
+    {
+        TIndex index((lfs::Span<size_t>(loadKeys)), lfs::Span<size_t>(loadKeys));
+        ScopedThreadPin pin;
+
+        size_t found = 0;
+        ClobberMemory();
+        uint64_t start = CycleTimer::Now();
+        for (const UpdateOperation& operation : operations)
+        {
+            if (operation.insert)
+                index.Insert(operation.key, operation.key);
+            else
+                found += index.Find(operation.key) ? 1 : 0;
+        }
+        FinishUpdates(index);
+        DoNotOptimize(found);
+        ClobberMemory();
+        ticks = CycleTimer::Now() - start;
+
+        ret.found = found;
+        ret.bytes = index.Bytes();
+    }
+    std::sort(runTicks, runTicks + c_perfTestTimedRuns);
+    ret.seconds = CycleTimer::Seconds(runTicks[c_perfTestTimedRuns / 2]);
+    return ret;
+}
+
+// Times lfs::GappedIndex and lfs::LogStructuredIndex against a B+ tree on mixes of inserts and finds. Half of the keys
+// are bulk loaded, and the other half are inserted in a random order, between finds of keys from all of them.
+void RunUpdateTest(const Options& options, uint64_t updateSeed)
+{
+    std::vector<size_t> sizes = options.sizes;
+    if (sizes.empty())
+        sizes.push_back(c_maxNumValues);
+
+    static const float c_insertFractions[] = { 0.1f, 0.5f, 0.9f };
+
+    struct Index
+    {
+        const char* name;
+        UpdateResult(*time)(const std::vector<size_t>& loadKeys, const std::vector<UpdateOperation>& operations);
+    };
+
+    static const Index c_indices[] =
+    {
+        { "B+ Tree", TimeUpdates<BlockIndex> },
+        { "Gapped Index", TimeUpdates<lfs::GappedIndex<size_t, size_t>> },
+        { "LSM Index", TimeUpdates<LogStructuredIndexAdapter> },
+    };
+
+    // each timed run pins itself once its index is made, so that a merge thread the index starts isn't kept on the CPU
+    // the operations are timed on
+    if (!ScopedThreadPin().Pinned())
+        printf("Could not pin the update test to a CPU, timings may be noisier\n");
+
+    CSVWriter csv;
+    if (csv.Open("out/Updates.csv"))
+    {
+        csv.Cell("Dataset");
+        csv.Cell("Sample Count");
+        csv.Cell("Insert Fraction");
+        csv.Cell("Index");
+        csv.Cell("ns Per Operation");
+        csv.Cell("Bytes Per Key");
+        csv.EndRow();
+    }
+
+    size_t mismatches = 0;
+    for (size_t numValues : sizes)
+    {
+        printf("Update test with %zu values\n", numValues);
+        for (const MakeListInfo& makeInfo : options.makeFns)
+        {
+            RNG rng(DeriveSeed(DeriveSeed(updateSeed, HashName(makeInfo.name)), numValues));
+            std::vector<size_t> keys;
+            makeInfo.fn(keys, numValues, rng);
+
+            // The lists repeat values, and an index holds each key once. Spreading the values out keeps the shape of
+            // the number sequence and makes every key different.
+            for (size_t index = 0; index < keys.size(); ++index)
+                keys[index] = keys[index] * numValues + index;
+
+            std::vector<size_t> shuffled = keys;
+            for (size_t index = shuffled.size(); index > 1; --index)
+                std::swap(shuffled[index - 1], shuffled[rng.Range(0, index - 1)]);
+
+            std::vector<size_t> loadKeys(shuffled.begin(), shuffled.begin() + shuffled.size() / 2);
+            std::sort(loadKeys.begin(), loadKeys.end());
+
+            for (float insertFraction : c_insertFractions)
+            {
+                // every key of the other half gets inserted, with finds mixed in between
+                std::vector<UpdateOperation> operations;
+                size_t nextInsert = shuffled.size() / 2;
+                while (nextInsert < shuffled.size())
+                {
+                    if (float(rng.Next() >> 40) / float(1 << 24) < insertFraction)
+                        operations.push_back({ true, shuffled[nextInsert++] });
+                    else
+                        operations.push_back({ false, keys[rng.Range(0, keys.size() - 1)] });
+                }
+
+                size_t expectedFound = 0;
+                for (size_t indexIndex = 0; indexIndex < countof(c_indices); ++indexIndex)
+                {
+                    UpdateResult result = c_indices[indexIndex].time(loadKeys, operations);
+
+                    // every index has to find the same keys
+                    if (indexIndex == 0)
+                        expectedFound = result.found;
+                    else if (result.found != expectedFound)
+                        mismatches++;
+
+                    double ns = result.seconds * 1000000000.0 / double(operations.size());
+                    double bytesPerKey = double(result.bytes) / double(keys.size());
+                    printf("  %s %s %.0f%% inserts : %f ns per operation, %f bytes per key\n", c_indices[indexIndex].name, makeInfo.name, insertFraction * 100.0f, ns, bytesPerKey);
+
+                    if (csv.file)
+                    {
+                        csv.Cell(makeInfo.name);
+                        csv.Cell(numValues);
+                        csv.Cell(insertFraction);
+                        csv.Cell(c_indices[indexIndex].name);
+                        csv.Cell(ns);
+                        csv.Cell(bytesPerKey);
+                        csv.EndRow();
+                    }
+                }
+            }
+        }
+        printf("\n");
+    }
+    csv.Close();
+
+    printf("Update test mismatches: %zu\n\n", mismatches);
+}
+
+// The timestamps of a time series test are a number sequence plus the index, which keeps the sequence's shape and makes
+// them strictly increasing
+void MakeTimestamps(const MakeListInfo& makeInfo, std::vector<size_t>& timestamps, size_t count, uint64_t seed)
+{
+    RNG rng(seed);
+    makeInfo.fn(timestamps, count, rng);
+    for (size_t index = 0; index < timestamps.size(); ++index)
+        timestamps[index] += index;
+}
+
+struct TimeSeriesResult
+{
+    double seconds = 0.0;
+    size_t checksum = 0;    // the sum of the floor indices, which the ways that don't make the list again have to agree on
+    size_t numSegments = 0;
+};
+
+typedef TimeSeriesResult(*TimeSeriesPassFn)(const MakeListInfo& makeInfo, const std::vector<size_t>& timestamps, uint64_t seed);
+
+// the time between searches after each append is random, and the same for every way of doing it
+static size_t TimeSeriesQuery(size_t first, size_t last, uint64_t seed, size_t step)
+{
+    return first + size_t(DeriveSeed(seed, step) % uint64_t(last - first + 1));
+}
+
+// Appends the timestamps one at a time to the index, and after each append looks up the last timestamp at or before a
+// random time
+TimeSeriesResult TimeSeriesIndexPass(const MakeListInfo&, const std::vector<size_t>& timestamps, uint64_t seed)
+{
+    TimeSeriesResult ret;
+    lfs::TimeSeriesIndex<size_t> index;
+    for (size_t step = 0; step < timestamps.size(); ++step)
+    {
+        index.Append(timestamps[step]);
+        lfs::SearchResult floor = index.Floor(TimeSeriesQuery(timestamps[0], timestamps[step], seed, step));
+        ret.checksum += floor.index;
+    }
+    ret.numSegments = index.NumSegments();
+    return ret;
+}
+
+// The same with a plain list that's appended to, searched with line fit
+TimeSeriesResult LineFitAppendedPass(const MakeListInfo&, const std::vector<size_t>& timestamps, uint64_t seed)
+{
+    TimeSeriesResult ret;
+    std::vector<size_t> values;
+    for (size_t step = 0; step < timestamps.size(); ++step)
+    {
+        values.push_back(timestamps[step]);
+        size_t query = TimeSeriesQuery(timestamps[0], timestamps[step], seed, step);
+        TestResults result = TestList_LineFit<SearchPolicy_None>(values, query);
+
+        // line fit stops next to where a missing value would go
+        size_t floor = result.index;
+        if (!result.found && values[floor] > query)
+            floor--;
+        ret.checksum += floor;
+    }
+    return ret;
+}
+
+// The same, making the whole list again before each search. The list made for n timestamps isn't the first n of the
+// full list, so the checksum doesn't match the others.
+TimeSeriesResult LineFitRegeneratedPass(const MakeListInfo& makeInfo, const std::vector<size_t>& timestamps, uint64_t seed)
+{
+    TimeSeriesResult ret;
+    std::vector<size_t> values;
+    for (size_t step = 0; step < timestamps.size(); ++step)
+    {
+        MakeTimestamps(makeInfo, values, step + 1, seed);
+        size_t query = TimeSeriesQuery(values[0], values[step], seed, step);
+        ret.checksum += TestList_LineFit<SearchPolicy_None>(values, query).index;
+    }
+    return ret;
+}
+
+// Runs the pass c_perfTestWarmupRuns times untimed and then c_perfTestTimedRuns times, and reports the median run. Every
+// run starts from nothing, so they all return the same checksum.
+TimeSeriesResult TimeTimeSeries(TimeSeriesPassFn pass, const MakeListInfo& makeInfo, const std::vector<size_t>& timestamps, uint64_t seed)
+{
+    TimeSeriesResult ret;
+    for (size_t warmupIndex = 0; warmupIndex < c_perfTestWarmupRuns; ++warmupIndex)
+        DoNotOptimize(pass(makeInfo, timestamps, seed).checksum);
+
+    double seconds = TimePasses([&]()
+    {
+        ret = pass(makeInfo, timestamps, seed);
+        DoNotOptimize(ret.checksum);
+    }, c_perfTestTimedRuns);
+    ret.seconds = seconds;
+    return ret;
+}
+
+// Times lfs::TimeSeriesIndex against line fit on a list that's made again after every append, which is what the other
+// search functions would need, and against line fit on a list that's appended to
+void RunTimeSeriesTest(const Options& options, uint64_t timeSeriesSeed)
+{
+    std::vector<size_t> sizes = options.sizes;
+    if (sizes.empty())
+        sizes.push_back(c_maxNumValues);
+
+    struct Method
+    {
+        const char* name;
+        TimeSeriesPassFn pass;
+        bool regenerates;
+    };
+
+    static const Method c_methods[] =
+    {
+        { "Line Fit Regenerated", LineFitRegeneratedPass, true },
+        { "Line Fit Appended", LineFitAppendedPass, false },
+        { "Time Series Index", TimeSeriesIndexPass, false },
+    };
+
+    ScopedThreadPin pin;
+    if (!pin.Pinned())
+        printf("Could not pin the time series test to a CPU, timings may be noisier\n");
+
+    CSVWriter csv;
+    if (csv.Open("out/TimeSeries.csv"))
+    {
+        csv.Cell("Dataset");
+        csv.Cell("Sample Count");
+        csv.Cell("Method");
+        csv.Cell("ns Per Append And Search");
+        csv.Cell("Segments");
+        csv.EndRow();
+    }
+
+    size_t mismatches = 0;
+    for (size_t numValues : sizes)
+    {
+        printf("Time series test with %zu values\n", numValues);
+        for (const MakeListInfo& makeInfo : options.makeFns)
+        {
+            uint64_t seed = DeriveSeed(DeriveSeed(timeSeriesSeed, HashName(makeInfo.name)), numValues);
+            std::vector<size_t> timestamps;
+            MakeTimestamps(makeInfo, timestamps, numValues, seed);
+
+            size_t expectedChecksum = 0;
+            bool haveChecksum = false;
+            for (const Method& method : c_methods)
+            {
+                if (method.regenerates && numValues > c_timeSeriesMaxRegenerate)
+                {
+                    printf("  %s %s : skipped, more than %zu values\n", method.name, makeInfo.name, c_timeSeriesMaxRegenerate);
+                    continue;
+                }
+
+                TimeSeriesResult result = TimeTimeSeries(method.pass, makeInfo, timestamps, seed);
+
+                // the ways that append have to find the same timestamps
+                if (!method.regenerates)
+                {
+                    if (!haveChecksum)
+                        expectedChecksum = result.checksum;
+                    else if (result.checksum != expectedChecksum)
+                        mismatches++;
+                    haveChecksum = true;
+                }
+
+                double ns = result.seconds * 1000000000.0 / double(timestamps.size());
+                printf("  %s %s : %f ns per append and search", method.name, makeInfo.name, ns);
+                if (result.numSegments)
+                    printf("  (%zu segments)", result.numSegments);
+                printf("\n");
+
+                if (csv.file)
+                {
+                    csv.Cell(makeInfo.name);
+                    csv.Cell(numValues);
+                    csv.Cell(method.name);
+                    csv.Cell(ns);
+                    csv.Cell(result.numSegments);
+                    csv.EndRow();
+                }
+            }
+        }
+        printf("\n");
+    }
+    csv.Close();
+
+    printf("Time series test mismatches: %zu\n\n", mismatches);
+}
+
+// Looks for each value of the smaller list in the larger one by galloping from where the last one was found, the usual
+// way of intersecting lists of different sizes
+size_t IntersectGalloping(lfs::Span<uint32_t> a, lfs::Span<uint32_t> b, uint32_t* out)
+{
+    lfs::Span<uint32_t> smaller = a.size() <= b.size() ? a : b;
+    lfs::Span<uint32_t> larger = a.size() <= b.size() ? b : a;
+
+    size_t count = 0;
+    size_t lowerBound = 0;
+    for (uint32_t value : smaller)
+    {
+        size_t maxIndex = lowerBound;
+        size_t step = 1;
+        while (maxIndex < larger.size() && larger[maxIndex] < value)
+        {
+            lowerBound = maxIndex + 1;
+            maxIndex += step;
+            step *= 2;
+        }
+        lowerBound = size_t(std::lower_bound(larger.data() + lowerBound, larger.data() + std::min(maxIndex, larger.size()), value) - larger.data());
+        if (lowerBound == larger.size())
+            break;
+        if (larger[lowerBound] == value)
+            out[count++] = value;
+    }
+    return count;
+}
+
+size_t IntersectStd(lfs::Span<uint32_t> a, lfs::Span<uint32_t> b, uint32_t* out)
+{
+    return size_t(std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), out) - out);
+}
+
+// Intersects more than two lists two at a time, smallest first, which keeps what's carried from one to the next small.
+// What's carried goes back and forth between out and scratch, so it ends up in out.
+template <size_t(*IntersectTwo)(lfs::Span<uint32_t> a, lfs::Span<uint32_t> b, uint32_t* out)>
+size_t IntersectSmallestFirst(const lfs::Span<uint32_t>* lists, size_t numLists, uint32_t* out, uint32_t* scratch)
+{
+    lfs::Span<uint32_t> sorted[c_intersectMaxLists];
+    std::copy(lists, lists + numLists, sorted);
+    for (size_t listIndex = 1; listIndex < numLists; ++listIndex)
+    {
+        for (size_t sortIndex = listIndex; sortIndex > 0 && sorted[sortIndex].size() < sorted[sortIndex - 1].size(); --sortIndex)
+            std::swap(sorted[sortIndex], sorted[sortIndex - 1]);
+    }
+
+    uint32_t* buffers[2] = { (numLists % 2) ? scratch : out, (numLists % 2) ? out : scratch };
+    size_t count = IntersectTwo(sorted[0], sorted[1], buffers[0]);
+    for (size_t listIndex = 2; listIndex < numLists; ++listIndex)
+        count = IntersectTwo(lfs::Span<uint32_t>(buffers[listIndex % 2], count), sorted[listIndex], buffers[(listIndex + 1) % 2]);
+    return count;
+}
+
+size_t IntersectLineFit(const lfs::Span<uint32_t>* lists, size_t numLists, uint32_t* out, uint32_t*)
+{
+    return lfs::Intersect(lists, numLists, out);
+}
+
+// An output with only room for the smaller list has to be enough for every way of merging, including when the end of
+// the larger list is past the last match. Each merge is called directly, since lfs::Intersect picks by size. Returns
+// how many got it wrong.
+size_t CheckIntersectOutputSize()
+{
+    typedef size_t(*MergeFn)(lfs::Span<uint32_t> a, lfs::Span<uint32_t> b, uint32_t* out);
+    static const MergeFn c_merges[] =
+    {
+        lfs::Intersect<uint32_t>,
+        [](lfs::Span<uint32_t> a, lfs::Span<uint32_t> b, uint32_t* out) { return lfs::detail::IntersectMergeBranching(a, b, out); },
+        [](lfs::Span<uint32_t> a, lfs::Span<uint32_t> b, uint32_t* out) { return lfs::detail::IntersectMerge(a, b, out); },
+#if LFS_HAS_SSE2()
+        [](lfs::Span<uint32_t> a, lfs::Span<uint32_t> b, uint32_t* out) { return lfs::detail::IntersectMergeSSE2(a, b, out); },
+#endif
+    };
+
+    static const uint32_t c_larger[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    static const uint32_t c_smaller[] = { 2, 3, 4, 5 };
+    lfs::Span<uint32_t> larger(c_larger);
+    lfs::Span<uint32_t> smaller(c_smaller);
+
+    size_t mismatches = 0;
+    for (MergeFn merge : c_merges)
+    {
+        // the vectors are exactly as big as the smaller list, so that an address sanitizer sees a write past them
+        std::vector<uint32_t> out(smaller.size());
+        out.resize(merge(larger, smaller, out.data()));
+        mismatches += std::equal(out.begin(), out.end(), smaller.begin(), smaller.end()) ? 0 : 1;
+
+        out.assign(smaller.size(), 0);
+        out.resize(merge(smaller, larger, out.data()));
+        mismatches += std::equal(out.begin(), out.end(), smaller.begin(), smaller.end()) ? 0 : 1;
+    }
+    return mismatches;
+}
+
+// The gallop that starts from a line's guess only runs on lists more than lfs::detail::c_intersectLineFitStride times
+// apart, that are close to a line, so it's called directly here. The larger list is squares, which a line through the
+// lower bound with the average slope fits badly: it guesses short of the values that are near the last one found, and
+// past 7000 * 7000, which is far from it, so both directions of the gallop run. Returns 1 if the intersection is wrong.
+size_t CheckIntersectLineGuess()
+{
+    std::vector<uint32_t> larger(8192);
+    for (size_t index = 0; index < larger.size(); ++index)
+        larger[index] = uint32_t(index * index);
+
+    // missing values, and one past the end, are looked for too
+    static const uint32_t c_smaller[] = { 1000 * 1000, 2000 * 2000, 3000 * 3000 + 1, 3500 * 3500, 7000 * 7000, 8191 * 8191 + 7 };
+    lfs::Span<uint32_t> smaller(c_smaller);
+
+    std::vector<uint32_t> expected;
+    std::set_intersection(larger.begin(), larger.end(), smaller.begin(), smaller.end(), std::back_inserter(expected));
+
+    double scale = double(larger.size() - 1) / double(larger.back() - larger.front());
+    std::vector<uint32_t> out(smaller.size());
+    out.resize(lfs::detail::IntersectGallop<true>(smaller, lfs::Span<uint32_t>(larger), scale, out.data()));
+    return out == expected ? 0 : 1;
+}
+
+// Intersects the lists c_perfTestTimedRuns times, after warming up, and reports the median time. Small lists are
+// intersected many times per run, so that a run is long enough to time. That lets the branch predictor learn small
+// lists, which flatters the merges that branch on every value.
+double TimeIntersect(size_t(*intersect)(const lfs::Span<uint32_t>* lists, size_t numLists, uint32_t* out, uint32_t* scratch),
+    const lfs::Span<uint32_t>* lists, size_t numLists, std::vector<uint32_t>& out)
+{
+    size_t totalValues = 0;
+    for (size_t listIndex = 0; listIndex < numLists; ++listIndex)
+        totalValues += lists[listIndex].size();
+    size_t repeats = std::max<size_t>(c_perfTestNumSearches / std::max<size_t>(totalValues, 1), 1);
+
+    std::vector<uint32_t> scratch(out.size());
+    size_t count = 0;
+    for (size_t runIndex = 0; runIndex < c_perfTestWarmupRuns; ++runIndex)
+        count = intersect(lists, numLists, out.data(), scratch.data());
+
+    uint64_t runTicks[c_perfTestTimedRuns];
+    for (uint64_t& ticks : runTicks)
+    {
+        ClobberMemory();
+        uint64_t start = CycleTimer::Now();
+        for (size_t repeat = 0; repeat < repeats; ++repeat)
+        {
+            count = intersect(lists, numLists, out.data(), scratch.data());
+            DoNotOptimize(count);
+            ClobberMemory();
+        }
+        ticks = CycleTimer::Now() - start;
+    }
+    out.resize(count);
+
+    std::sort(runTicks, runTicks + c_perfTestTimedRuns);
+    return CycleTimer::Seconds(runTicks[c_perfTestTimedRuns / 2]) / double(repeats);
+}
+
+// Times lfs::Intersect against std::set_intersection and galloping, on two and three lists. The lists are picked at
+// random from a number sequence: the largest gets about half of it, and the smallest a fraction of that, which is
+// the size ratio.
+void RunIntersectTest(const Options& options, uint64_t intersectSeed)
+{
+    std::vector<size_t> sizes = options.sizes;
+    if (sizes.empty())
+    {
+        sizes.push_back(c_maxNumValues);
+        sizes.push_back(c_intersectLargeNumValues);
+    }
+
+    // the largest ratios are past lfs::detail::c_intersectLineFitStride, where lfs::Intersect guesses with a line
+    static const size_t c_sizeRatios[] = { 1, 4, 16, 64, 256, 1024, 4096 };
+
+    struct Method
+    {
+        const char* name;
+        size_t(*intersect)(const lfs::Span<uint32_t>* lists, size_t numLists, uint32_t* out, uint32_t* scratch);
+    };
+
+    static const Method c_methods[] =
+    {
+        { "std::set_intersection", IntersectSmallestFirst<IntersectStd> },
+        { "Galloping", IntersectSmallestFirst<IntersectGalloping> },
+        { "lfs::Intersect", IntersectLineFit },
+    };
+
+    ScopedThreadPin pin;
+    if (!pin.Pinned())
+        printf("Could not pin the intersect test to a CPU, timings may be noisier\n");
+
+    CSVWriter csv;
+    if (csv.Open("out/Intersect.csv"))
+    {
+        csv.Cell("Dataset");
+        csv.Cell("Sample Count");
+        csv.Cell("Lists");
+        csv.Cell("Size Ratio");
+        csv.Cell("Method");
+        csv.Cell("Intersection Size");
+        csv.Cell("ns Per Intersection");
+        csv.EndRow();
+    }
+
+    size_t mismatches = CheckIntersectOutputSize() + CheckIntersectLineGuess();
+    for (size_t numValues : sizes)
+    {
+        printf("Intersect test with %zu values\n", numValues);
+        for (const MakeListInfo& makeInfo : options.makeFns)
+        {
+            RNG rng(DeriveSeed(DeriveSeed(intersectSeed, HashName(makeInfo.name)), numValues));
+            std::vector<size_t> sequence;
+            makeInfo.fn(sequence, numValues, rng);
+
+            // spread out like the update test's keys, so that there are no repeats
+            std::vector<uint32_t> values(sequence.size());
+            bool fits = true;
+            for (size_t index = 0; index < sequence.size(); ++index)
+            {
+                size_t value = sequence[index] * numValues + index;
+                fits = fits && value <= size_t(UINT32_MAX);
+                values[index] = uint32_t(value);
+            }
+            if (!fits)
+            {
+                printf("  %s : skipped, the values don't fit in 32 bits\n", makeInfo.name);
+                continue;
+            }
+
+            for (size_t sizeRatio : c_sizeRatios)
+            {
+                // the smaller list picks one value in 2 * sizeRatio
+                if (values.size() < 2 * sizeRatio * c_intersectMinSmallerValues)
+                {
+                    printf("  %s 1:%zu : skipped, too few values for the smaller list\n", makeInfo.name, sizeRatio);
+                    continue;
+                }
+
+                std::vector<uint32_t> picked[c_intersectMaxLists];
+                size_t pickRates[c_intersectMaxLists] = { 2, 2 * sizeRatio, 2 };
+                for (size_t listIndex = 0; listIndex < c_intersectMaxLists; ++listIndex)
+                {
+                    for (uint32_t value : values)
+                    {
+                        if (rng.Range(1, pickRates[listIndex]) == 1)
+                            picked[listIndex].push_back(value);
+                    }
+                }
+
+                lfs::Span<uint32_t> lists[c_intersectMaxLists];
+                for (size_t listIndex = 0; listIndex < c_intersectMaxLists; ++listIndex)
+                    lists[listIndex] = lfs::Span<uint32_t>(picked[listIndex]);
+
+                for (size_t numLists = 2; numLists <= c_intersectMaxLists; ++numLists)
+                {
+                    std::vector<uint32_t> expected;
+                    for (size_t methodIndex = 0; methodIndex < countof(c_methods); ++methodIndex)
+                    {
+                        const Method& method = c_methods[methodIndex];
+                        std::vector<uint32_t> out(values.size());
+                        double seconds = TimeIntersect(method.intersect, lists, numLists, out);
+
+                        // every method has to find the same values
+                        if (methodIndex == 0)
+                            expected = out;
+                        else if (out != expected)
+                            mismatches++;
+
+                        double ns = seconds * 1000000000.0;
+                        printf("  %s %s %zu lists 1:%zu : %f ns per intersection, %zu values in it\n", method.name, makeInfo.name, numLists, sizeRatio, ns, out.size());
+
+                        if (csv.file)
+                        {
+                            csv.Cell(makeInfo.name);
+                            csv.Cell(numValues);
+                            csv.Cell(numLists);
+                            csv.Cell(sizeRatio);
+                            csv.Cell(method.name);
+                            csv.Cell(out.size());
+                            csv.Cell(ns);
+                            csv.EndRow();
+                        }
+                    }
+                }
+            }
+        }
+        printf("\n");
+    }
+    csv.Close();
+
+    printf("Intersect test mismatches: %zu\n\n", mismatches);
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    int exitCode = 0;
+    if (!ParseCommandLine(argc, argv, options, exitCode))
+        return exitCode;
+
+    if (!options.convertFileName.empty())
+    {
+        std::string csvFileName = options.convertFileName;
+        size_t extension = csvFileName.rfind(".lfsr");
+        if (extension != std::string::npos)
+            csvFileName.erase(extension);
+        csvFileName += ".csv";
+
+        if (!ConvertBinaryResultsToCSV(options.convertFileName.c_str(), csvFileName.c_str()))
+        {
+            printf("Could not convert %s\n", options.convertFileName.c_str());
+            return 1;
+        }
+        printf("Wrote %s\n", csvFileName.c_str());
+        return 0;
+    }
+
+    // a comparison uses the baseline's seed, so that it sees the same searches
+    if (!options.compareDirectory.empty() && !options.seedGiven)
+    {
+        FILE* file = nullptr;
+        fopen_s(&file, (options.compareDirectory + "/Seed.txt").c_str(), "rb");
+        unsigned long long seed = 0;
+        if (file && fscanf(file, "%llu", &seed) == 1)
+        {
+            options.seed = seed;
+            options.seedGiven = true;
+        }
+        if (file)
+            fclose(file);
+        if (!options.seedGiven)
+        {
+            printf("Could not read the seed from %s/Seed.txt. Pass the baseline's seed with --seed\n", options.compareDirectory.c_str());
+            return 1;
+        }
+    }
+
+    // Every random number in a run comes from this seed
+    if (!options.seedGiven)
+    {
+        std::random_device rd;
+        options.seed = (uint64_t(rd()) << 32) | uint64_t(rd());
+    }
+    printf("Seed: %llu\n", (unsigned long long)options.seed);
+
+    // record the seed next to the results it makes, whatever the modes, so that --compare can use them as a baseline
+    {
+        FILE* file = nullptr;
+        fopen_s(&file, "out/Seed.txt", "w+b");
+        if (!file)
+        {
+            printf("Could not write out/Seed.txt\n");
+            return 1;
+        }
+        fprintf(file, "%llu\n", (unsigned long long)options.seed);
+        fclose(file);
+    }
+
+    // each mode gets its own stream, so that running one doesn't change another
+    if (options.sweep)
+        RunSweep(options, DeriveSeed(options.seed, 0));
+
+    // the tuned parameters go to the perf test, along with any loaded with --hybrid-config
+    if (options.tune)
+    {
+        std::vector<HybridTuning> tunings = RunTuning(options, DeriveSeed(options.seed, 3));
+        options.hybridTunings.insert(options.hybridTunings.end(), tunings.begin(), tunings.end());
+    }
+
+    if (options.perf)
+        RunPerfTest(options, DeriveSeed(options.seed, 1));
+
+    if (options.throughput)
+        RunThroughputTest(options, DeriveSeed(options.seed, 2));
+
+    if (options.fixedSize)
+        RunFixedSizeTest(options, DeriveSeed(options.seed, 5));
+
+    if (options.container)
+        RunContainerTest(options, DeriveSeed(options.seed, 6));
+
+    if (options.updates)
+        RunUpdateTest(options, DeriveSeed(options.seed, 7));
+
+    if (options.timeSeries)
+        RunTimeSeriesTest(options, DeriveSeed(options.seed, 8));
+
+    if (options.intersect)
+        RunIntersectTest(options, DeriveSeed(options.seed, 9));
+
+    if (!options.compareDirectory.empty() && CompareWithBaseline(options, DeriveSeed(options.seed, 4)) > 0)
+        exitCode = 2;
+
+    // a comparison is run unattended, by a script that wants the exit code
+    if (options.pause && options.compareDirectory.empty())
+        system("pause");
+
+    return exitCode;
 }